@@ -2,18 +2,19 @@
 #define SPOTLIGHT_CLIENT_H
 
 #include <wx/wx.h>
-#include "file_crawler.h"
-#include "trie.h"
+#include "shard_set.h"
+#include "search_result.h"
+#include <vector>
 
 class Client : public wxApp {
 private:
-    TrieSearch trieSearcher;
-    FileSystemCrawler* crawler;
+    ShardSet shards;
 
 public:
     virtual bool OnInit() override;
-    std::vector<SQLiteWrapper::FileResult> indexSearch(std::string &query);
-    std::vector<FileInfo> trieSearch(std::string &prefix, int num_results=10);
+    std::vector<SearchResult> search(const std::string &text, int num_results=10);
+    // Counts an activation of result towards its file's frecency.
+    void recordOpen(const SearchResult &result);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,45 @@
+//
+// Created by a7x on 19/10/2026.
+//
+
+#ifndef SPOTLIGHT_COLUMN_STORE_H
+#define SPOTLIGHT_COLUMN_STORE_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "query_parser.h"
+#include "sqlite_wrapper.h"
+
+// Per-file metadata packed into parallel arrays indexed by fileid, so a
+// filter is a straight scan the compiler can vectorise. The last filter's
+// match mask is cached because the filters rarely change between keystrokes.
+class ColumnStore {
+private:
+    std::vector<uint64_t> sizes;
+    std::vector<int64_t> mtimes;
+    std::vector<uint16_t> ext_ids;
+    std::vector<uint8_t> present;
+    std::unordered_map<std::string, uint16_t> ext_dictionary;
+
+    std::string cached_key;
+    std::vector<uint8_t> cached_mask;
+
+    uint16_t intern_extension(const std::string& ext);
+
+public:
+    static constexpr uint16_t NO_EXTENSION = 0;
+
+    void load(const SQLiteWrapper& db);
+    size_t size() const;
+    uint16_t extension_id(const std::string& ext) const;
+
+    const std::vector<uint8_t>& scan(const SearchQuery& query);
+    std::vector<int64_t> first_matches(const std::vector<uint8_t>& mask, size_t n,
+                                       const std::function<bool(int64_t)>& accept = nullptr) const;
+};
+
+#endif //SPOTLIGHT_COLUMN_STORE_H
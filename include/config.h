@@ -0,0 +1,67 @@
+//
+// Created by a7x on 19/10/2026.
+//
+
+#ifndef SPOTLIGHT_CONFIG_H
+#define SPOTLIGHT_CONFIG_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "ignored_folders.h"
+
+static const std::string DEFAULT_CONFIG_PATH = "/etc/spotlight.conf";
+
+// Settings read from a "key = value" file; '#' starts a comment. Missing
+// files and keys keep the defaults below.
+struct SpotlightConfig
+{
+    // Every root is indexed into its own shard under index_dir; roots is a
+    // comma-separated list.
+    std::vector<std::string> roots = {"/home"};
+    std::string index_dir = "/home/a7x";
+
+    // Directories and files the crawl skips, as comma-separated gitignore
+    // patterns; ignore_files name the per-directory files whose patterns
+    // are layered on top as the walk descends (empty to ignore them).
+    std::vector<std::string> ignore = default_ignore_rules;
+    std::vector<std::string> ignore_files = default_ignore_files;
+
+    // Keeps each crawl on its root's filesystem, like find -xdev: whatever
+    // is mounted below a root is skipped. Bind mounts and symlinks back into
+    // already crawled directories are skipped either way.
+    bool one_filesystem = false;
+
+    // Shared by all shards; 0 keeps every trie fully resident.
+    size_t trie_memory_budget_mb = 0;
+
+    // Rescan intervals per top-level directory, in seconds. A directory
+    // whose contents changed since its last scan has its interval halved,
+    // an unchanged one has it doubled, within [min, max].
+    size_t scan_min_interval_s = 60;
+    size_t scan_max_interval_s = 3600;
+    size_t scan_initial_interval_s = 300;
+
+    // The crawl backs off while any of these is exceeded: PSI "some avg10"
+    // percentages from /proc/pressure, or the 1-minute load average per CPU
+    // when PSI is unavailable. 0 disables a check.
+    double io_pressure_limit = 10.0;
+    double cpu_pressure_limit = 40.0;
+    double load_limit = 1.5;
+    bool idle_io_priority = true;
+
+    // Optional full-text indexing of file contents. Only the first
+    // content_max_file_kb of each text file is read; reads are held to
+    // content_max_mb_per_s (0 = unthrottled), and the text held in memory
+    // at once is sized so the process stays under content_max_rss_mb.
+    bool content_indexing = false;
+    size_t content_workers = 2;
+    size_t content_max_file_kb = 1024;
+    size_t content_max_mb_per_s = 32;
+    size_t content_max_rss_mb = 512;
+};
+
+SpotlightConfig load_config(const std::string &path = DEFAULT_CONFIG_PATH);
+
+#endif //SPOTLIGHT_CONFIG_H
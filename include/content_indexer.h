@@ -0,0 +1,63 @@
+//
+// Created by a7x on 19/10/2026.
+//
+
+#ifndef SPOTLIGHT_CONTENT_INDEXER_H
+#define SPOTLIGHT_CONTENT_INDEXER_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "config.h"
+#include "sqlite_wrapper.h"
+
+struct ContentStats
+{
+    uint64_t files_read = 0;
+    uint64_t text_files = 0;
+    uint64_t binary_files = 0;
+    uint64_t bytes_read = 0;
+    bool reset = false;
+};
+
+// Indexes the words inside text files into the database's content FTS
+// table. Files that are new or modified since they were last read are
+// fetched in chunks; a pool of workers streams each one through a small
+// buffer, gives up on it at the first block if it looks binary, and keeps
+// at most max_file_bytes of it. Each chunk is written in one transaction.
+//
+// Memory stays bounded because a chunk never holds more extracted text than
+// the headroom left under the RSS limit, and reads share one rate limit.
+class ContentIndexer
+{
+private:
+    using clock = std::chrono::steady_clock;
+
+    SQLiteWrapper &db;
+    size_t workers;
+    size_t max_file_bytes;
+    uint64_t max_bytes_per_s;
+    size_t max_rss_bytes;
+    std::function<void()> chunk_hook;
+
+    std::mutex rate_mutex;
+    clock::time_point window_start;
+    uint64_t window_bytes = 0;
+
+    size_t chunk_size() const;
+    void throttle(size_t bytes);
+    size_t extract(const SQLiteWrapper::ContentCandidate &file, SQLiteWrapper::ContentDocument &doc,
+                   std::vector<char> &buffer);
+
+public:
+    ContentIndexer(SQLiteWrapper &db, const SpotlightConfig &config);
+
+    // Called before every chunk; the indexer uses it to back off under load.
+    void set_chunk_hook(std::function<void()> hook);
+    ContentStats run();
+};
+
+#endif //SPOTLIGHT_CONTENT_INDEXER_H
@@ -0,0 +1,29 @@
+//
+// Created by a7x on 19/10/2026.
+//
+
+#ifndef SPOTLIGHT_CRAWL_CHECKPOINT_H
+#define SPOTLIGHT_CRAWL_CHECKPOINT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Progress of an unfinished crawl. Everything the crawl found outside of
+// `pending` is already committed to the database under `generation`, so a
+// restarted indexer only has to walk the pending directories.
+struct CrawlCheckpoint
+{
+    int64_t generation = 0;
+    uint64_t batches = 0;
+    std::string root;
+    std::vector<std::string> pending;
+};
+
+// Written to a temporary file and renamed over the old one, so a crash
+// leaves either the previous checkpoint or the new one.
+bool save_checkpoint(const std::string &path, const CrawlCheckpoint &checkpoint);
+bool load_checkpoint(const std::string &path, CrawlCheckpoint &checkpoint);
+void remove_checkpoint(const std::string &path);
+
+#endif //SPOTLIGHT_CRAWL_CHECKPOINT_H
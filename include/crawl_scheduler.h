@@ -0,0 +1,74 @@
+//
+// Created by a7x on 19/10/2026.
+//
+
+#ifndef SPOTLIGHT_CRAWL_SCHEDULER_H
+#define SPOTLIGHT_CRAWL_SCHEDULER_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "file_crawler.h"
+
+// Decides what the indexer rescans and when. Each top-level directory under
+// the crawl root is scheduled on its own: directories whose contents keep
+// changing are rescanned down to scan_min_interval_s apart, quiet ones drift
+// out to scan_max_interval_s. A full crawl every scan_max_interval_s picks up
+// new top-level directories and files directly under the root.
+//
+// While crawling, every batch checks system pressure and sleeps with
+// exponential backoff until I/O and CPU pressure drop below the limits.
+class CrawlScheduler {
+public:
+    using clock = std::chrono::steady_clock;
+
+private:
+    struct Unit {
+        std::string path;
+        std::chrono::seconds interval;
+        clock::time_point next_due;
+        uint64_t fingerprint = 0;
+        bool scanned = false;
+    };
+
+    FileSystemCrawler& crawler;
+    SpotlightConfig config;
+    std::vector<Unit> units;
+    clock::time_point next_full_crawl;
+    std::chrono::milliseconds throttled{0};
+
+    void discover();
+    void restart_clocks();
+    void crawl_unit(Unit& unit);
+    bool under_pressure() const;
+
+public:
+    CrawlScheduler(FileSystemCrawler& crawler, const SpotlightConfig& config);
+
+    // Crawls whatever is due and returns true if anything was crawled.
+    bool tick();
+    void full_crawl();
+
+    // For a restarted indexer whose saved index was loaded into the
+    // crawler, or none was saved and from_database rebuilds it: finishes
+    // the crawl a checkpoint says was interrupted, then schedules from
+    // there instead of crawling everything again. Returns true if a crawl
+    // was resumed.
+    bool resume(bool from_database = false);
+    clock::time_point next_due() const;
+
+    // Sleeps with exponential backoff while the system is under pressure.
+    void throttle();
+
+    // Total time spent backing off since the last call.
+    std::chrono::milliseconds take_throttled_time();
+
+    // Puts the calling thread in the idle I/O class and lowers its CPU
+    // priority, so crawling only uses the disk when nothing else wants it.
+    static void lower_thread_priority();
+};
+
+#endif //SPOTLIGHT_CRAWL_SCHEDULER_H
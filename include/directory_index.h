@@ -0,0 +1,80 @@
+//
+// Created by a7x on 19/10/2026.
+//
+
+#ifndef SPOTLIGHT_DIRECTORY_INDEX_H
+#define SPOTLIGHT_DIRECTORY_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Every indexed directory numbered in a depth-first pre-order, so the
+// directories under one form a contiguous range of numbers, and every file
+// tagged with its directory's number. Whether a file lies under a directory
+// is then two integer comparisons, with no path strings involved. The
+// indexer adds and removes files as batches are written; number() assigns
+// the ranges and save() runs it.
+class DirectoryIndex {
+public:
+    // Numbers of a directory and everything below it, first..last. The
+    // default interval contains nothing.
+    struct Interval {
+        uint32_t first = 1;
+        uint32_t last = 0;
+    };
+
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    std::unordered_map<std::string, uint32_t> ids;
+    std::vector<std::string> paths;
+    std::vector<uint32_t> parents;
+    std::vector<Interval> intervals;
+    // Per fileid: the id of its directory, and that directory's number.
+    std::vector<uint32_t> file_dirs;
+    std::vector<uint32_t> file_numbers;
+    bool numbered = true;
+    // Directories the crawl reached again through a symlink or bind mount,
+    // mapped to the path their contents are indexed under.
+    std::unordered_map<std::string, std::string> aliases;
+
+    static std::string parent_of(const std::string& path);
+    uint32_t intern(const std::string& directory);
+
+public:
+    // A file's directory never changes for its fileid, so a file already in
+    // the index is skipped.
+    void add(const std::string& absolute_path, int64_t fileid);
+    void remove(int64_t fileid);
+    void add_alias(const std::string& alias, const std::string& target);
+    // Drops the aliases at or below directory.
+    void remove_aliases(const std::string& directory);
+    void clear();
+    void number();
+
+    bool empty() const;
+    size_t directory_count() const;
+    // Every directory interned so far, including ones whose files have
+    // since been removed.
+    const std::vector<std::string>& directories() const;
+
+    // The interval of directory, as of the last number(); false if no
+    // indexed file lies under it. A path through an alias is looked up
+    // under the alias's target.
+    bool find(const std::string& directory, Interval& out) const;
+
+    bool contains(const Interval& scope, int64_t fileid) const {
+        if (fileid < 0 || static_cast<uint64_t>(fileid) >= file_numbers.size()) {
+            return false;
+        }
+        uint32_t n = file_numbers[fileid];
+        return n >= scope.first && n <= scope.last;
+    }
+
+    void save(const std::string& filename);
+    bool load(const std::string& filename);
+};
+
+#endif //SPOTLIGHT_DIRECTORY_INDEX_H
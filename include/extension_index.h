@@ -0,0 +1,37 @@
+//
+// Created by a7x on 19/10/2026.
+//
+
+#ifndef SPOTLIGHT_EXTENSION_INDEX_H
+#define SPOTLIGHT_EXTENSION_INDEX_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "roaring_bitmap.h"
+
+// One compressed fileid bitmap per (lowercased) extension. The indexer keeps
+// it up to date as batches are written and saves it next to the trie; the
+// client answers ext: filters by AND-ing candidates against it.
+class ExtensionIndex {
+private:
+    std::unordered_map<std::string, RoaringBitmap> bitmaps;
+
+    static std::string normalize(const std::string& ext);
+
+public:
+    void add(const std::string& ext, int64_t fileid);
+    void remove(const std::string& ext, int64_t fileid);
+    void clear();
+
+    const RoaringBitmap* find(const std::string& ext) const;
+    RoaringBitmap match_any(const std::vector<std::string>& extensions) const;
+    uint64_t count(const std::string& ext) const;
+    bool empty() const;
+
+    void save(const std::string& filename) const;
+    bool load(const std::string& filename);
+};
+
+#endif //SPOTLIGHT_EXTENSION_INDEX_H
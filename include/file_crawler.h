@@ -6,10 +6,20 @@
 #include <iostream>
 #include <stack>
 #include "ignored_folders.h"
+#include "ignore_rules.h"
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
+#include <functional>
+#include <chrono>
 #include "sqlite_wrapper.h"
 #include "trie.h"
+#include "statx_batch.h"
+#include "extension_index.h"
+#include "token_index.h"
+#include "directory_index.h"
+#include "crawl_checkpoint.h"
+#include "path_index.h"
 
 using string = std::string;
 
@@ -19,27 +29,158 @@ struct FileRecord
     string absolute_path;
     string extension;
     std::unordered_set<string> tokens;
+    int64_t fileid = -1;
+
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint32_t uid = 0;
+    bool has_metadata = false;
+};
+
+// Summary of the last crawl(), including how many vanished files it swept
+// from the index; the fingerprint is an order-independent mix
+// of every file's path, size and mtime, so it changes whenever a file is
+// added, removed or modified under the crawled root.
+struct CrawlStats
+{
+    uint64_t files = 0;
+    uint64_t directories = 0;
+    uint64_t fingerprint = 0;
+    uint64_t removed = 0;
+    uint64_t aliases = 0;
+    uint64_t other_filesystems = 0;
+};
+
+// A directory's identity on disk, whichever path reached it.
+struct DirectoryKey
+{
+    uint64_t dev;
+    uint64_t ino;
+
+    bool operator==(const DirectoryKey &other) const
+    {
+        return dev == other.dev && ino == other.ino;
+    }
+};
+
+struct DirectoryKeyHash
+{
+    size_t operator()(const DirectoryKey &key) const
+    {
+        return std::hash<uint64_t>()(key.ino * 0x9e3779b97f4a7c15ULL ^ key.dev);
+    }
 };
 
+enum class CrawlBackend
+{
+    Iterator,
+    Getdents
+};
+
+std::unordered_set<std::string> tokenize(const std::string &str);
+string slice_after_last(const string &str, char delimiter);
+string extension_of(const string &filename);
+
 class FileSystemCrawler
 {
 private:
     string root_path;
 
-    SQLiteWrapper db_wrapper = SQLiteWrapper("/home/a7x/crawl.db");
+    SQLiteWrapper db_wrapper;
 
     TrieSearch trie_searcher = TrieSearch();
+    ExtensionIndex extension_index;
+    TokenIndex token_index;
+    DirectoryIndex directory_index;
+    PathIndex known_paths;
+    IgnoreChain ignore_root;
+    std::vector<string> ignore_files;
     static constexpr short SEARCH_LIMIT = 10;
+    static constexpr size_t BATCH_SIZE = 1000;
+
+#ifdef __linux__
+    CrawlBackend backend = CrawlBackend::Getdents;
+#else
+    CrawlBackend backend = CrawlBackend::Iterator;
+#endif
+    std::vector<FileRecord> file_batch;
+
+    bool collect_metadata = true;
+    StatxBatcher stat_batcher;
+    std::vector<FileRecord> stat_pending;
+
+    CrawlStats stats;
+    std::function<void()> batch_hook;
+
+    // Every crawl() stamps the rows it writes with a new generation. With a
+    // checkpoint path set, the directories still to visit are saved every
+    // CHECKPOINT_INTERVAL once everything before them is committed.
+    int64_t generation = 0;
+    uint64_t batches_committed = 0;
+    string crawl_root;
+    std::vector<string> queued_dirs;
+    string checkpoint_path;
+    std::chrono::steady_clock::time_point last_checkpoint;
+    static constexpr std::chrono::seconds CHECKPOINT_INTERVAL{30};
+
+    // Every directory walked so far, by identity, with the path it was
+    // indexed under. One reached again through a symlink or a bind mount is
+    // an alias: it goes into the directory index instead of being walked
+    // twice. Symlinked directories, and mount roots where the kernel marks
+    // them, are walked last, so the real path is the one indexed whenever
+    // both lie under the crawl.
+    std::unordered_map<DirectoryKey, string, DirectoryKeyHash> visited_dirs;
+    std::vector<string> deferred_links;
+    bool one_filesystem = false;
+    uint64_t root_dev = 0;
 
+    void add_file(FileRecord &&rec);
+    void flush_batch();
+    void drain();
+    void run_queue();
+    void sweep();
+    void walk(const string &dir);
+    void crawl_iterator(const string &root, IgnoreChain ignore);
+    void crawl_getdents(const string &root, IgnoreChain ignore);
+    IgnoreChain ignore_chain_for(const string &dir) const;
+    bool is_ignore_file(const char *name) const;
+    bool claim_directory(const string &path, uint64_t dev, uint64_t ino);
+    void checkpoint_if_due(const std::function<void(std::vector<string> &)> &frontier);
 
 public:
-    FileSystemCrawler(const string &path) : root_path(path) {}
+    FileSystemCrawler(const string &path, const string &db_path = "");
     void initializing_crawl();
     void crawl(const string &root);
+    void set_backend(CrawlBackend b);
+    void set_collect_metadata(bool enabled);
+    void set_batch_hook(std::function<void()> hook);
+    void set_checkpoint_path(const string &path);
+    // Keeps the crawl on the filesystem of the crawler's root, skipping
+    // whatever is mounted below it.
+    void set_one_filesystem(bool enabled);
+    // patterns are gitignore lines relative to the crawler's root;
+    // ignore_file_names are read from each directory as it is listed.
+    void set_ignore_rules(const std::vector<string> &patterns, const std::vector<string> &ignore_file_names);
+    // Continues the crawl recorded in the checkpoint, if there is one. The
+    // files it had already committed are put back into the trie and
+    // extension index first, so those must hold the last saved index;
+    // with from_database set they start empty and every file in the
+    // database is put back instead.
+    bool resume_crawl(bool from_database = false);
+    int64_t get_generation() const;
+    const CrawlStats &last_crawl_stats() const;
+    const string &get_root() const;
     bool is_ignorable(const string &folder_name);
     void process_files(std::vector<FileRecord> &files);
-    std::vector<SQLiteWrapper::FileResult> index_search(std::string &prefix, short offset = 0);
+    std::vector<SQLiteWrapper::FileResult> index_search(std::string &prefix,
+                                                        SQLiteWrapper::SearchCursor *cursor = nullptr,
+                                                        const std::function<bool(int64_t)> &accept = nullptr);
     TrieSearch& get_trie();
+    SQLiteWrapper& get_db();
+    ExtensionIndex& get_extension_index();
+    TokenIndex& get_token_index();
+    DirectoryIndex& get_directory_index();
+    PathIndex& get_path_index();
 
 };
 
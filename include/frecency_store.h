@@ -0,0 +1,81 @@
+//
+// Created by a7x on 19/10/2026.
+//
+
+#ifndef SPOTLIGHT_FRECENCY_STORE_H
+#define SPOTLIGHT_FRECENCY_STORE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// How often and how recently each file of a shard was opened from the
+// client, kept in a small memory-mapped hash table keyed by fileid so every
+// client process shares it. A slot's score and the minute it was last
+// updated share one 64-bit word. A writer holds the slot by setting
+// LOCKED in its key with a CAS for the two stores that change it, so
+// readers never block and never take one file's score for another's.
+// Scores halve every HALF_LIFE_MINUTES.
+class FrecencyStore {
+private:
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t capacity;
+        std::atomic<uint64_t> updates;
+    };
+
+    struct Slot {
+        std::atomic<int64_t> key;
+        std::atomic<uint64_t> value;
+    };
+
+    static constexpr uint32_t CAPACITY = 1 << 16;
+    static constexpr size_t MAX_PROBE = 32;
+    static constexpr int64_t LOCKED = int64_t(1) << 62;
+    // A writer finding its slot held gives up after this many tries; the
+    // open is lost, which only costs a ranking hint.
+    static constexpr int MAX_LOCK_TRIES = 64;
+    static constexpr int MAX_READ_TRIES = 4;
+    static constexpr double HALF_LIFE_MINUTES = 3 * 24 * 60;
+
+    int fd = -1;
+    void* mapping = nullptr;
+    size_t mapped_bytes = 0;
+    bool writable = false;
+    Header* header = nullptr;
+    Slot* slots = nullptr;
+
+    static uint64_t pack(float score, uint32_t minute);
+    static double decayed(uint64_t value, uint32_t now);
+    static uint32_t current_minute();
+    size_t home(int64_t fileid) const;
+    static bool read_slot(const Slot& slot, int64_t& key, uint64_t& value);
+    Slot* lock_slot(int64_t key, uint32_t now);
+    bool map_file(const std::string& path, bool create);
+
+public:
+    FrecencyStore() = default;
+    FrecencyStore(const FrecencyStore&) = delete;
+    FrecencyStore& operator=(const FrecencyStore&) = delete;
+    ~FrecencyStore();
+
+    // Falls back to read-only when the file can't be written, and to an
+    // empty store when it can't be opened at all.
+    bool open(const std::string& path);
+    void close();
+    bool is_open() const;
+
+    void record_open(int64_t fileid);
+    double score(int64_t fileid) const;
+
+    // Bumped on every record_open, so readers know when cached rankings
+    // are out of date.
+    uint64_t version() const;
+    // The n highest scoring fileids, best first.
+    std::vector<std::pair<int64_t, double>> top(size_t n) const;
+};
+
+#endif //SPOTLIGHT_FRECENCY_STORE_H
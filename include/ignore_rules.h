@@ -0,0 +1,88 @@
+//
+// Created by a7x on 19/10/2026.
+//
+
+#ifndef SPOTLIGHT_IGNORE_RULES_H
+#define SPOTLIGHT_IGNORE_RULES_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class IgnoreMatch
+{
+    None,
+    Ignore,
+    Keep
+};
+
+// One set of gitignore-style patterns, compiled once. Plain names ("build")
+// and "*.ext" patterns, which are most of any real ignore file, are looked
+// up in hash tables; only the remaining globs are matched one by one. As in
+// git, the last matching pattern decides, and "!pattern" re-includes.
+class IgnoreRules
+{
+private:
+    enum class Kind
+    {
+        Literal,
+        Extension,
+        Suffix,
+        Prefix,
+        Glob
+    };
+
+    struct Rule
+    {
+        std::string pattern;
+        Kind kind = Kind::Glob;
+        bool negate = false;
+        bool dir_only = false;
+        // Anchored patterns contain a '/' and match the path relative to the
+        // directory the rules came from; the rest match the entry's name.
+        bool anchored = false;
+    };
+
+    std::vector<Rule> rules;
+    std::unordered_map<std::string, std::vector<int>> literals;
+    std::unordered_map<std::string, std::vector<int>> extensions;
+    std::vector<int> scanned;
+    bool any_file_rules = false;
+
+    bool applies(const Rule &rule, const char *relative, const char *name, bool is_dir) const;
+
+public:
+    void add(const std::string &line);
+    bool load(const std::string &path);
+    bool empty() const;
+
+    IgnoreMatch match(const char *relative, const char *name, bool is_dir) const;
+};
+
+// The rules in force in one directory: its own ignore files, then its
+// parent's layer, out to the configured rules at the top. Each layer is
+// shared by the directories below it, so a walk can hand one to every
+// directory it queues without copying rules.
+struct IgnoreLayer
+{
+    std::shared_ptr<const IgnoreLayer> parent;
+    IgnoreRules rules;
+    // Directory the rules came from, with a trailing '/'.
+    std::string base;
+};
+
+using IgnoreChain = std::shared_ptr<const IgnoreLayer>;
+
+// The innermost layer with a matching pattern decides.
+bool is_ignored(const IgnoreChain &chain, const std::string &path, const char *name, bool is_dir);
+
+// Layer for dir_path on top of parent, built from those of the named
+// ignore files that exist there, later files taking precedence; parent
+// itself when none has any rules.
+IgnoreChain enter_directory(const IgnoreChain &parent, const std::string &dir_path,
+                            const std::vector<std::string> &ignore_files);
+
+bool glob_match(const char *pattern, const char *text);
+
+#endif //SPOTLIGHT_IGNORE_RULES_H
@@ -5,14 +5,26 @@
 #ifndef SPOTLIGHT_IGNORED_FOLDERS_H
 #define SPOTLIGHT_IGNORED_FOLDERS_H
 #include <string>
-#include <unordered_set>
+#include <vector>
 
-static std::unordered_set<std::string> ignored_folders_list = {
-    "node_modules",
-    "build",
-    ".git",
-    "R"
+// gitignore syntax; a trailing '/' limits a pattern to directories, and
+// ".*/" skips every hidden directory (.git, .cache, .venv, ...).
+static const std::vector<std::string> default_ignore_rules = {
+    "node_modules/",
+    "build/",
+    ".*/",
+    "R/",
+    "target/",
+    "__pycache__/",
+    "venv/"
+};
+
+// Per-directory files whose patterns apply below the directory holding
+// them, in increasing order of precedence.
+static const std::vector<std::string> default_ignore_files = {
+    ".gitignore",
+    ".ignore"
 };
 
 
-#endif //SPOTLIGHT_IGNORED_FOLDERS_H
\ No newline at end of file
+#endif //SPOTLIGHT_IGNORED_FOLDERS_H
@@ -0,0 +1,45 @@
+//
+// Created by a7x on 19/10/2026.
+//
+
+#ifndef SPOTLIGHT_PATH_INDEX_H
+#define SPOTLIGHT_PATH_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class SQLiteWrapper;
+
+// Every indexed path, reduced to a 64-bit hash, mapped to its fileid in an
+// open-addressing table (16 bytes a slot, at most 70% full). It lets the
+// crawler tell new files from known ones without asking SQLite. A hash
+// can collide, so a hit is only a claim: the database write that follows
+// checks the stored path, and falls back to a normal upsert if it differs.
+class PathIndex {
+private:
+    struct Slot {
+        uint64_t hash = 0;
+        int64_t fileid = -1;
+    };
+
+    std::vector<Slot> slots;
+    size_t count = 0;
+
+    static uint64_t hash_path(const std::string& path);
+    size_t home(uint64_t hash) const;
+    void grow();
+
+public:
+    int64_t find(const std::string& path) const;
+    void insert(const std::string& path, int64_t fileid);
+    void erase(const std::string& path);
+    void clear();
+
+    size_t size() const;
+    size_t memory_bytes() const;
+
+    void load(const SQLiteWrapper& db);
+};
+
+#endif //SPOTLIGHT_PATH_INDEX_H
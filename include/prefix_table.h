@@ -0,0 +1,58 @@
+//
+// Created by a7x on 19/10/2026.
+//
+
+#ifndef SPOTLIGHT_PREFIX_TABLE_H
+#define SPOTLIGHT_PREFIX_TABLE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "sqlite_wrapper.h"
+#include "token_index.h"
+
+// Ranked results for every query of one to MAX_PREFIX characters. These
+// are the queries typed most often, and the most expensive: their trie
+// subtrees and token expansions cover much of the index. For each prefix
+// the table keeps the first TOP_K filenames starting with it, shortest
+// first as the trie's breadth-first walk finds them, and the TOP_K best
+// token index matches with their ranks, all as fileid arrays. The indexer
+// builds it from each snapshot it saves.
+class PrefixTable {
+public:
+    static constexpr size_t MAX_PREFIX = 3;
+    static constexpr size_t TOP_K = 16;
+
+private:
+    struct Entry {
+        uint32_t key;
+        uint32_t names_offset;
+        uint32_t tokens_offset;
+        uint8_t names;
+        uint8_t tokens;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<uint32_t> name_ids;
+    std::vector<uint32_t> token_ids;
+    std::vector<float> token_ranks;
+
+    static uint32_t key_of(const char* prefix, size_t length);
+
+public:
+    // Reads filenames from db and token matches from tokens, which must
+    // be compacted.
+    void build(const SQLiteWrapper& db, const TokenIndex& tokens);
+    bool empty() const;
+
+    // The lists for prefix, case-folded; false if the table can't answer
+    // it, being empty or prefix too long. A prefix no file has is answered
+    // with empty lists.
+    bool lookup(const std::string& prefix, std::vector<int64_t>& names, std::vector<TokenIndex::Match>& tokens) const;
+
+    void save(const std::string& filename) const;
+    bool load(const std::string& filename);
+};
+
+#endif //SPOTLIGHT_PREFIX_TABLE_H
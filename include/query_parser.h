@@ -0,0 +1,37 @@
+//
+// Created by a7x on 19/10/2026.
+//
+
+#ifndef SPOTLIGHT_QUERY_PARSER_H
+#define SPOTLIGHT_QUERY_PARSER_H
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+// A search box query split into free text and structured filters:
+//   ext:pdf,docx        extension is one of the list
+//   size:>10MB          also <, >=, <=, and ranges like size:1k..4M
+//   modified:<7d        changed within the last 7 days (h, d, w, y)
+//   modified:>2026-01-01, modified:today, modified:week
+//   in:~/work/spotlight only files under that directory
+// Anything that doesn't parse as a filter stays part of the text.
+struct SearchQuery {
+    std::string text;
+    std::vector<std::string> extensions;
+    uint64_t min_size = 0;
+    uint64_t max_size = std::numeric_limits<uint64_t>::max();
+    int64_t min_mtime = std::numeric_limits<int64_t>::min();
+    int64_t max_mtime = std::numeric_limits<int64_t>::max();
+    std::string scope;
+
+    bool has_filters() const;
+    bool has_metadata_filters() const;
+    std::string filter_key() const;
+};
+
+SearchQuery parse_query(const std::string& input, int64_t now);
+SearchQuery parse_query(const std::string& input);
+
+#endif //SPOTLIGHT_QUERY_PARSER_H
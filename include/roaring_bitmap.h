@@ -0,0 +1,58 @@
+//
+// Created by a7x on 19/10/2026.
+//
+
+#ifndef SPOTLIGHT_ROARING_BITMAP_H
+#define SPOTLIGHT_ROARING_BITMAP_H
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <vector>
+
+// Compressed set of 32-bit ids in the style of Roaring: ids are split by
+// their high 16 bits into containers, each holding either a sorted array of
+// low halves (sparse) or a 65536-bit bitmap (dense, past 4096 entries).
+class RoaringBitmap {
+private:
+    struct Container {
+        uint16_t key = 0;
+        uint32_t cardinality = 0;
+        std::vector<uint16_t> array;
+        std::vector<uint64_t> bits;
+
+        bool is_bitmap() const { return !bits.empty(); }
+        bool contains(uint16_t low) const;
+        bool add(uint16_t low);
+        bool remove(uint16_t low);
+        void to_bitmap();
+        void to_array();
+    };
+
+    std::vector<Container> containers;
+
+    Container* find_container(uint16_t key);
+    const Container* find_container(uint16_t key) const;
+    static Container and_containers(const Container& a, const Container& b);
+    static Container or_containers(const Container& a, const Container& b);
+
+public:
+    static constexpr uint32_t ARRAY_LIMIT = 4096;
+
+    void add(uint32_t value);
+    void remove(uint32_t value);
+    bool contains(uint32_t value) const;
+    uint64_t cardinality() const;
+    bool empty() const;
+
+    RoaringBitmap operator&(const RoaringBitmap& other) const;
+    RoaringBitmap operator|(const RoaringBitmap& other) const;
+
+    // Visits ids in ascending order until the callback returns false.
+    void for_each(const std::function<bool(uint32_t)>& visit) const;
+
+    void write(std::ofstream& out) const;
+    bool read(std::ifstream& in);
+};
+
+#endif //SPOTLIGHT_ROARING_BITMAP_H
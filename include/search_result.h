@@ -0,0 +1,48 @@
+//
+// Created by a7x on 19/10/2026.
+//
+
+#ifndef SPOTLIGHT_SEARCH_RESULT_H
+#define SPOTLIGHT_SEARCH_RESULT_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One candidate from any engine, scored on a shared scale: filename prefix
+// hits from the trie land in [0.6, 1], FTS path-token hits in [0, 0.5) and
+// hits inside file contents in [0, 0.4), plus up to 0.5 for files the user
+// opens often. shard is the index of the shard it came from, since fileids
+// are only unique within one.
+struct SearchResult {
+    std::string filename;
+    std::string absolute_path;
+    std::string extension;
+    int64_t fileid = -1;
+    double score = 0.0;
+    int shard = -1;
+};
+
+// Keeps the k best results seen so far in a min-heap, deduplicated by path
+// (fileids repeat across shards) keeping the higher score.
+class TopKMerger {
+private:
+    size_t k;
+    std::vector<SearchResult> heap;
+    std::unordered_map<std::string, size_t> positions;
+
+    static const std::string& key(const SearchResult& r);
+    static bool better(const SearchResult& a, const SearchResult& b);
+    void sift_up(size_t i);
+    void sift_down(size_t i);
+    void swap_entries(size_t a, size_t b);
+
+public:
+    explicit TopKMerger(size_t k);
+
+    void add(SearchResult result);
+    std::vector<SearchResult> take();
+};
+
+#endif //SPOTLIGHT_SEARCH_RESULT_H
@@ -0,0 +1,68 @@
+//
+// Created by a7x on 19/10/2026.
+//
+
+#ifndef SPOTLIGHT_SHARD_H
+#define SPOTLIGHT_SHARD_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "config.h"
+
+// Where one root's index lives. Each configured root gets a directory of
+// its own under index_dir/shards holding its database, trie, extension,
+// token and directory indexes, prefix table and spill file, so shards are
+// built, queried and rebuilt without touching one another. The client keeps its open counts there too, since
+// they are keyed by the shard's fileids.
+struct ShardLayout
+{
+    std::string name;
+    std::string root;
+    std::string directory;
+    std::string db_path;
+    std::string trie_path;
+    std::string ext_index_path;
+    std::string token_index_path;
+    std::string dir_index_path;
+    std::string prefix_table_path;
+    std::string spill_path;
+    std::string checkpoint_path;
+    std::string frecency_path;
+    std::string snapshot_path;
+};
+
+ShardLayout shard_layout(const SpotlightConfig &config, const std::string &root);
+std::vector<ShardLayout> shard_layouts(const SpotlightConfig &config);
+
+// The configured ignore patterns, plus one keeping the crawl out of
+// index_dir/shards when that lies under the shard's root: otherwise every
+// crawl re-indexes the databases it just wrote and the scheduler sees the
+// root as always changing.
+std::vector<std::string> shard_ignore_rules(const SpotlightConfig &config, const ShardLayout &shard);
+
+// A rebuild is requested by dropping a marker file in the shard directory,
+// which the running indexer picks up on its next poll.
+bool request_rebuild(const ShardLayout &shard);
+bool take_rebuild_request(const ShardLayout &shard);
+
+// Written by the indexer after each save, once every snapshot file (trie,
+// extension, token and directory indexes, prefix table) has been renamed
+// into place. A client reloads the files when the generation changes, and
+// only uses them while database_id matches the live database's: after a
+// rebuild the same fileids name different files.
+struct SnapshotStamp
+{
+    uint64_t generation = 0;
+    std::string database_id;
+};
+
+bool write_snapshot_stamp(const ShardLayout &shard, const SnapshotStamp &stamp);
+// False, leaving the stamp untouched, when no snapshot has been published.
+bool read_snapshot_stamp(const ShardLayout &shard, SnapshotStamp &stamp);
+
+// Deletes the shard's index files, leaving the directory in place.
+void remove_shard_files(const ShardLayout &shard);
+
+#endif //SPOTLIGHT_SHARD_H
@@ -0,0 +1,107 @@
+//
+// Created by a7x on 19/10/2026.
+//
+
+#ifndef SPOTLIGHT_SHARD_SEARCHER_H
+#define SPOTLIGHT_SHARD_SEARCHER_H
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "column_store.h"
+#include "directory_index.h"
+#include "extension_index.h"
+#include "frecency_store.h"
+#include "prefix_table.h"
+#include "query_parser.h"
+#include "search_result.h"
+#include "shard.h"
+#include "sqlite_wrapper.h"
+#include "token_index.h"
+#include "trie.h"
+
+// Wall time of each part of one search. The engines run concurrently, so
+// they overlap; assembly is the merging and scoring done after them.
+struct SearchTiming {
+    double trie_ms = 0.0;
+    double fts_ms = 0.0;
+    double content_ms = 0.0;
+    double assembly_ms = 0.0;
+};
+
+// The client's view of one shard: its trie, database, metadata columns,
+// extension bitmaps, token postings, directory intervals and prefix table.
+// Fileids are only unique within a shard, so filters are built and applied
+// here before results leave it.
+class ShardSearcher {
+private:
+    // The files the indexer publishes together, and the metadata columns
+    // as of the same save. A newer set is loaded in the background and
+    // swapped in whole between searches.
+    struct Snapshot {
+        TrieSearch trieSearcher;
+        ColumnStore columns;
+        ExtensionIndex extensionIndex;
+        TokenIndex tokenIndex;
+        DirectoryIndex directoryIndex;
+        PrefixTable prefixTable;
+        std::string databaseId;
+    };
+
+    ShardLayout layout;
+    SQLiteWrapper db;
+    std::unique_ptr<Snapshot> snapshot;
+    std::future<std::unique_ptr<Snapshot>> nextSnapshot;
+    uint64_t snapshotGeneration = 0;
+    std::string databaseId;
+    uint64_t databaseDevice = 0;
+    uint64_t databaseInode = 0;
+    int64_t databaseChanged = 0;
+    std::string cachedExtensionKey;
+    RoaringBitmap cachedExtensionBitmap;
+    std::string cachedScope;
+    RoaringBitmap cachedScopeBitmap;
+    FrecencyStore frecency;
+    std::vector<SQLiteWrapper::FileResult> hotFiles;
+    uint64_t hotVersion = UINT64_MAX;
+
+    static constexpr short SEARCH_LIMIT = 10;
+    static constexpr size_t HOT_FILES = 64;
+
+    static std::unique_ptr<Snapshot> loadSnapshot(const ShardLayout& layout, const SnapshotStamp& stamp);
+    bool databaseReplaced();
+    void refreshSnapshot();
+    const RoaringBitmap* extensionFilter(const SearchQuery& query);
+    const RoaringBitmap* scopeFallback(const SearchQuery& query);
+    bool outOfScope(const SearchQuery& query);
+    std::function<bool(int64_t)> buildFilter(const SearchQuery& query);
+    bool precomputedSearch(const SearchQuery& query, int num_results, std::vector<FileInfo>& names,
+                           std::vector<SQLiteWrapper::FileResult>& tokens);
+    std::vector<FileInfo> trieSearch(const SearchQuery& query, int num_results,
+                                     const std::function<bool(int64_t)>& accept);
+    std::vector<FuzzyMatch> fuzzySearch(const SearchQuery& query, int num_results,
+                                        const std::function<bool(int64_t)>& accept);
+    std::vector<SQLiteWrapper::FileResult> indexSearch(const SearchQuery& query,
+                                                       const std::function<bool(int64_t)>& accept);
+    std::vector<SQLiteWrapper::FileResult> contentSearch(const SearchQuery& query,
+                                                         const std::function<bool(int64_t)>& accept);
+    std::vector<SQLiteWrapper::FileResult> hotSearch(const SearchQuery& query,
+                                                     const std::function<bool(int64_t)>& accept);
+    double frecencyBoost(int64_t fileid) const;
+
+public:
+    explicit ShardSearcher(const ShardLayout& layout);
+
+    void load();
+    const ShardLayout& getLayout() const;
+
+    // The shard's own top results, scored on the shared scale so they can
+    // be merged with other shards'.
+    std::vector<SearchResult> search(const SearchQuery& query, int num_results, SearchTiming* timing = nullptr);
+    void recordOpen(int64_t fileid);
+};
+
+#endif //SPOTLIGHT_SHARD_SEARCHER_H
@@ -0,0 +1,32 @@
+//
+// Created by a7x on 19/10/2026.
+//
+
+#ifndef SPOTLIGHT_SHARD_SET_H
+#define SPOTLIGHT_SHARD_SET_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "search_result.h"
+#include "shard_searcher.h"
+
+// Every shard the client searches, queried together. Kept apart from the
+// wx application so the same search path can be driven headless.
+class ShardSet {
+private:
+    std::vector<std::unique_ptr<ShardSearcher>> shards;
+
+public:
+    void add(const ShardLayout& layout);
+    // Loads every shard in parallel.
+    void load();
+    size_t size() const;
+
+    std::vector<SearchResult> search(const std::string& text, int num_results = 10,
+                                     SearchTiming* timing = nullptr);
+    void recordOpen(const SearchResult& result);
+};
+
+#endif //SPOTLIGHT_SHARD_SET_H
@@ -5,6 +5,9 @@
 #include <sqlite3.h>
 #include <vector>
 #include <unordered_set>
+#include <functional>
+#include <memory>
+#include <cstdint>
 
 struct FileRecord;
 
@@ -12,22 +15,74 @@ class SQLiteWrapper
 {
 private:
     std::string db_path;
+    bool read_only = false;
+
+    static constexpr size_t OPTIMIZE_AFTER_REMOVED = 1000;
+    // Bytes of the database each connection reads through a memory map
+    // instead of read() calls.
+    static constexpr int64_t MMAP_SIZE = 256ll << 20;
+    static constexpr int BUSY_TIMEOUT_MS = 5000;
+
+    static void configure(sqlite3 *db, bool writer);
 
 public:
-    SQLiteWrapper(const std::string &path);
+    // The database runs in WAL mode, so the indexer's writes and any number
+    // of client readers proceed without blocking one another. A read-only
+    // wrapper never creates or alters the schema.
+    SQLiteWrapper(const std::string &path, bool read_only = false);
 
     struct FileResult {
         std::string filename;
         std::string absolute_path;
         std::string extension;
+        int64_t fileid = -1;
+        double rank = 0.0;
+    };
+
+    // Where a ranked search stopped: the (rank, rowid) of the last row it
+    // examined. Start with a default cursor and pass the same one back for
+    // each following page. The first page opens a read transaction that
+    // the later ones share, so rows the indexer commits meanwhile can't
+    // shift the ranking between pages; it ends once the last page is read
+    // or the cursor is destroyed. While it lasts checkpoints can't pass
+    // it, so don't keep an unfinished cursor around.
+    struct SearchCursor {
+        double rank = 0.0;
+        int64_t rowid = 0;
+        bool started = false;
+        bool exhausted = false;
+        std::shared_ptr<sqlite3> connection;
+    };
+
+    struct ContentCandidate {
+        int64_t fileid;
+        std::string absolute_path;
+        int64_t mtime;
+        uint64_t size;
+    };
+
+    // Extracted words of one file; binaries are recorded with is_text false
+    // so they are not read again until they change.
+    struct ContentDocument {
+        int64_t fileid = -1;
+        int64_t mtime = 0;
+        bool is_text = false;
+        std::string body;
     };
 
     sqlite3 *open_db() const;
     void close_db(sqlite3 *db) const;
 
+    // Copies committed WAL frames back into the database file. Connections
+    // never do this themselves, so commits and closes stay cheap; the
+    // indexer calls it from a background thread. A passive checkpoint
+    // waits on nobody; truncate waits for readers and then empties the WAL.
+    static bool checkpoint(const std::string &path, bool truncate = false);
+
     bool exists() const;
     bool check_tables() const;
     void init_tables();
+    void upgrade_tables();
     int insert_file(const std::string &filename,
                     const std::string &abs_path,
                     const std::string &ext);
@@ -37,11 +92,42 @@ public:
 
     bool insert_token(const std::string &token, int fileid);
 
-    void batch_insert_files(std::vector<FileRecord> &files);
+    // Every row written or refreshed is stamped with the crawl's generation.
+    // A record's fileid, when already set, is taken as a hint that the path
+    // is known.
+    void batch_insert_files(std::vector<FileRecord> &files, int64_t generation = 0);
     // void debug_print_tokens(int limit = 20) const;
     // void debug_print_files(int limit = 20) const;
 
-    std::vector<FileResult> search(const std::string &prefix,short limit, short offset) const;
+    std::vector<FileResult> search(const std::string &prefix, short limit, SearchCursor *cursor = nullptr,
+                                   const std::function<bool(int64_t)> &accept = nullptr) const;
+    std::vector<FileResult> get_files(const std::vector<int64_t> &fileids) const;
+    std::vector<ContentCandidate> content_candidates(int64_t after_fileid, size_t limit) const;
+    void batch_insert_content(const std::vector<ContentDocument> &docs);
+    void count_content_documents(int64_t &live, int64_t &stale) const;
+    void reset_content_index();
+    std::vector<FileResult> search_content(const std::string &prefix, short limit, SearchCursor *cursor = nullptr,
+                                           const std::function<bool(int64_t)> &accept = nullptr) const;
+    void scan_paths(const std::function<void(int64_t fileid, const char *path)> &visit) const;
+    // Drawn when the database is created and never changed; empty for a
+    // database written before ids were kept.
+    std::string database_id() const;
+    int64_t max_generation() const;
+    void scan_generation(int64_t generation, const std::function<void(const FileResult &)> &visit) const;
+    void scan_files(const std::function<void(const FileResult &)> &visit) const;
+    // Every file at or below the directory scope, found by range on the
+    // path index.
+    void scan_scope(const std::string &scope, const std::function<void(int64_t fileid)> &visit) const;
+    // Deletes every row under scope older than generation, i.e. files the
+    // crawl that wrote it no longer found, passing each to visit first.
+    size_t sweep_generation(int64_t generation, const std::string &scope,
+                            const std::function<void(const FileResult &)> &visit);
+    void scan_metadata(const std::function<void(int64_t fileid, uint64_t size, int64_t mtime,
+                                                const char *extension)> &visit) const;
+
+private:
+    sqlite3 *cursor_db(SearchCursor *cursor) const;
+    void release_db(sqlite3 *db, SearchCursor *cursor) const;
 };
 
 #endif
@@ -0,0 +1,71 @@
+//
+// Created by a7x on 19/10/2026.
+//
+
+#ifndef SPOTLIGHT_STATX_BATCH_H
+#define SPOTLIGHT_STATX_BATCH_H
+
+#include <cstddef>
+#include <vector>
+
+struct FileRecord;
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct statx;
+
+// Fills size/mtime/uid of a batch of FileRecords. Requests are queued on an
+// io_uring as IORING_OP_STATX so the kernel resolves them concurrently while
+// the caller keeps working; when the ring cannot be created (old kernel,
+// io_uring disabled by sysctl or seccomp) submit() stats every record
+// serially instead. A submitted batch must stay in place until wait().
+class StatxBatcher
+{
+private:
+    int ring_fd = -1;
+    unsigned ring_entries = 0;
+
+    void *sq_ring = nullptr;
+    void *cq_ring = nullptr;
+    size_t sq_ring_size = 0;
+    size_t cq_ring_size = 0;
+    io_uring_sqe *sqes = nullptr;
+    size_t sqes_size = 0;
+
+    unsigned *sq_head = nullptr;
+    unsigned *sq_tail = nullptr;
+    unsigned *sq_mask = nullptr;
+    unsigned *sq_array = nullptr;
+    unsigned *cq_head = nullptr;
+    unsigned *cq_tail = nullptr;
+    unsigned *cq_mask = nullptr;
+    io_uring_cqe *cqes = nullptr;
+
+    std::vector<FileRecord> *in_flight = nullptr;
+    std::vector<struct statx> results;
+    // Result buffers of a ring that failed with requests in flight. The
+    // kernel may still write into them, so they live as long as the
+    // batcher and are never reused.
+    std::vector<std::vector<struct statx>> abandoned;
+    unsigned submitted = 0;
+    unsigned completed = 0;
+
+    bool setup(unsigned entries);
+    bool supports_statx();
+    void teardown();
+    void abandon_ring(std::vector<FileRecord> &files, size_t count);
+    void reap();
+    void stat_serial(std::vector<FileRecord> &files, size_t begin, size_t end);
+
+public:
+    explicit StatxBatcher(unsigned entries = 1024);
+    ~StatxBatcher();
+    StatxBatcher(const StatxBatcher &) = delete;
+    StatxBatcher &operator=(const StatxBatcher &) = delete;
+
+    bool uses_io_uring() const;
+    void submit(std::vector<FileRecord> &files);
+    void wait();
+    void stat_all(std::vector<FileRecord> &files);
+};
+
+#endif //SPOTLIGHT_STATX_BATCH_H
@@ -0,0 +1,91 @@
+//
+// Created by a7x on 19/10/2026.
+//
+
+#ifndef SPOTLIGHT_TOKEN_INDEX_H
+#define SPOTLIGHT_TOKEN_INDEX_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Path tokens to fileids, the same postings fts_index holds but kept in
+// memory so the client can answer multi-token queries without SQLite. The
+// token dictionary is sorted for prefix lookups; each posting list is cut
+// into blocks of BLOCK_SIZE ids stored as varint gaps, with every block's
+// first and last id kept aside so intersections gallop over whole blocks
+// and only decode the ones that can hold a match.
+//
+// The indexer adds and removes files as batches are written; changes are
+// folded into the compressed lists by compact(), which save() runs.
+// Searches see the index as of the last compaction.
+class TokenIndex {
+public:
+    static constexpr uint32_t BLOCK_SIZE = 128;
+
+    // rank follows bm25(): lower is better.
+    struct Match {
+        int64_t fileid;
+        double rank;
+    };
+
+private:
+    struct Block {
+        uint32_t first;
+        uint32_t last;
+        uint32_t offset;
+    };
+
+    struct Term {
+        std::string token;
+        uint32_t count;
+        uint32_t first_block;
+    };
+
+    class Cursor;
+
+    std::vector<Term> terms;
+    std::vector<Block> blocks;
+    std::vector<uint8_t> bytes;
+    // Tokens in each file's path, capped at 255; zero for files not in the
+    // index. Doubles as the membership test that makes add() idempotent.
+    std::vector<uint8_t> lengths;
+    uint64_t documents = 0;
+    double average_length = 0.0;
+
+    std::unordered_map<std::string, std::vector<uint32_t>> pending;
+    std::unordered_set<uint32_t> removed;
+
+    uint32_t block_size(const Term& term, uint32_t block) const;
+    void decode_block(const Term& term, uint32_t block, std::vector<uint32_t>& out) const;
+    void decode(const Term& term, std::vector<uint32_t>& out) const;
+    void append_term(const std::string& token, const std::vector<uint32_t>& ids);
+    std::vector<uint32_t> expand(size_t begin, size_t end) const;
+    void recount();
+
+public:
+    // A path's tokens never change for its fileid, so a file already in the
+    // index is skipped.
+    void add(const std::unordered_set<std::string>& tokens, int64_t fileid);
+    void remove(int64_t fileid);
+    void clear();
+    void compact();
+
+    bool empty() const;
+    uint64_t size() const;
+    // Distinct leading substrings, one to max_length bytes long, of the
+    // indexed tokens.
+    std::vector<std::string> prefixes(size_t max_length) const;
+
+    // Files whose tokens start with every one of prefixes, best first.
+    std::vector<Match> search(const std::vector<std::string>& prefixes, size_t limit,
+                              const std::function<bool(int64_t)>& accept = nullptr) const;
+
+    void save(const std::string& filename);
+    bool load(const std::string& filename);
+};
+
+#endif //SPOTLIGHT_TOKEN_INDEX_H
@@ -11,21 +11,38 @@
 
 #include <iostream>
 #include <fstream>
+#include <functional>
+#include <cstdint>
+#include <memory>
 
 struct FileInfo {
     std::string filename;
     std::string absolute_path;
     std::string extension;
+    int64_t fileid = -1;
 
     FileInfo() = default;
-    FileInfo(const std::string& name, const std::string& path, const std::string& ext)
-        : filename(name), absolute_path(path), extension(ext) {}
+    FileInfo(const std::string& name, const std::string& path, const std::string& ext, int64_t id = -1)
+        : filename(name), absolute_path(path), extension(ext), fileid(id) {}
 };
 
+struct FuzzyMatch {
+    FileInfo info;
+    int distance = 0;
+};
+
+// A leaf keeps every file sharing its (lowercased) name, so files with the
+// same name in different directories don't overwrite each other. Leaves
+// past INDEXED_LEAF files (index.js, Makefile, __init__.py) also hash their
+// paths, so a re-crawl re-adding each of them isn't quadratic. Editing the
+// files directly drops the hash; the next add rebuilds it.
 class TrieNode {
 private:
+    static constexpr size_t INDEXED_LEAF = 16;
+
     bool is_leaf;
-    FileInfo file_info;
+    std::vector<FileInfo> files;
+    std::unique_ptr<std::unordered_multimap<size_t, size_t>> path_slots;
     std::unordered_map<char, TrieNode*> children;
 
 public:
@@ -34,36 +51,117 @@ public:
 
     bool check_leaf();
     void set_leaf(bool leaf);
-    void set_file_info(const FileInfo& info);
-    FileInfo get_file_info();
+    // True if info is a new path; changed (if given) also reports an
+    // existing entry that info replaced with different details.
+    bool add_file_info(const FileInfo& info, bool* changed = nullptr);
+    const std::vector<FileInfo>& get_files() const;
+    std::vector<FileInfo>& edit_files();
     bool has_child(char c);
     TrieNode* get_child(char c);
     TrieNode* add_child(char c);
     std::unordered_map<char, TrieNode*>& get_children();
 };
 
+struct TrieCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t resident_bytes = 0;
+    size_t budget_bytes = 0;
+    size_t spilled_subtrees = 0;
+};
+
+// With a memory budget set, the subtrees hanging off depth SPILL_DEPTH are
+// the unit of eviction: the least recently used ones are written to a spill
+// file and left as empty stubs, then read back the next time a search
+// reaches them. Inserts into a spilled subtree are queued on the stub and
+// merged when it is read back, so a crawl doesn't thrash the spill file.
+// Rewritten subtrees leave their old copies behind; once those make up
+// half the spill file, the live copies are moved to a fresh one.
+// Memory use is an estimate, not an exact count.
 class TrieSearch {
 private:
+    struct FuzzyWalk;
+
+    struct SpillUnit {
+        uint64_t last_access = 0;
+        size_t bytes = 0;
+        bool spilled = false;
+        bool dirty = true;
+        std::streamoff offset = -1;
+        std::streamoff length = 0;
+        // Keyed by path, so re-adding a file already queued replaces it.
+        std::unordered_map<std::string, FileInfo> pending;
+    };
+
+    static constexpr size_t SPILL_DEPTH = 2;
+    static constexpr size_t BUDGET_CHECK_INTERVAL = 4096;
+    static constexpr std::streamoff SPILL_COMPACT_MIN = 4 << 20;
+
     TrieNode* root;
 
+    size_t memory_budget = 0;
+    std::string spill_path;
+    std::fstream spill;
+    std::streamoff spill_bytes = 0;
+    std::streamoff spill_dead = 0;
+    std::unordered_map<TrieNode*, SpillUnit> units;
+    size_t resident_bytes = 0;
+    uint64_t access_clock = 0;
+    size_t inserts_since_check = 0;
+    size_t freed_bytes = 0;
+    bool removed_any = false;
+    TrieCacheStats stats;
+
     void collect_all_files(TrieNode* node, std::string prefix, std::vector<FileInfo>& results);
-    void collect_n_files(TrieNode* node, const std::string& prefix, std::vector<FileInfo>& results, int n);
-    bool remove_helper(TrieNode* node, const std::string& filename, int depth);
-    void save_node(TrieNode* node, std::ofstream& out);
-    TrieNode* load_node(std::ifstream& in);
+    void collect_n_files(TrieNode* node, const std::string& prefix, std::vector<FileInfo>& results, int n,
+                         const std::function<bool(const FileInfo&)>& accept = nullptr);
+    void fuzzy_walk(TrieNode* node, size_t depth, const std::vector<int>& row, int best, FuzzyWalk& walk);
+    void fuzzy_collect(TrieNode* node, size_t depth, int distance, FuzzyWalk& walk);
+    bool remove_files(const std::string& filename, const std::string* absolute_path);
+    bool remove_helper(TrieNode* node, const std::string& filename, size_t depth,
+                       const std::string* absolute_path);
+    void save_node(TrieNode* node, std::ostream& out, size_t depth = 0);
+    TrieNode* load_node(std::istream& in);
+
+    static size_t node_bytes(TrieNode* node);
+    static size_t file_bytes(const FileInfo& info);
+    size_t subtree_bytes(TrieNode* node);
+    SpillUnit& unit_state(TrieNode* unit);
+    SpillUnit& touch(TrieNode* unit);
+    size_t insert_below(TrieNode* node, const FileInfo& info, size_t depth, bool& changed);
+    TrieNode* descend(TrieNode* node, char c, size_t depth);
+    void evict(TrieNode* unit, SpillUnit& state);
+    void fault_in(TrieNode* unit, SpillUnit& state);
+    TrieNode* read_spilled(const SpillUnit& state);
+    void drop_copy(SpillUnit& state);
+    void reset_spill();
+    void compact_spill();
+    void account_all();
+    void enforce_budget();
 
 public:
     TrieSearch();
     ~TrieSearch();
 
-    void insert(const std::string& filename, const std::string& absolute_path, const std::string& extension);
+    void insert(const std::string& filename, const std::string& absolute_path, const std::string& extension,
+                int64_t fileid = -1);
     bool search(const std::string& filename);
     std::vector<FileInfo> search_prefix(const std::string& prefix);
     std::vector<FileInfo> search_prefix_n_results(const std::string& prefix, int num_results);
+    std::vector<FileInfo> search_prefix_n_results(const std::string& prefix, int num_results,
+                                                  const std::function<bool(const FileInfo&)>& accept);
+    // Names with some prefix within max_distance edits of prefix, nearest
+    // first.
+    std::vector<FuzzyMatch> search_fuzzy_n_results(const std::string& prefix, int max_distance, int num_results,
+                                                   const std::function<bool(const FileInfo&)>& accept = nullptr);
     bool remove(const std::string& filename);
+    bool remove_file(const std::string& filename, const std::string& absolute_path);
     void save(const std::string& filename);
-    void load(const std::string& filename);
+    bool load(const std::string& filename);
 
+    void set_memory_budget(size_t bytes, const std::string& spill_file);
+    TrieCacheStats cache_stats() const;
 
 };
 
@@ -22,7 +22,9 @@ private:
 
 
     std::string query;
+    std::vector<SearchResult> results;
     void onTextInput(wxCommandEvent& event);
+    void openResult(size_t index);
 
 };
 
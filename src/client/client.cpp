@@ -1,9 +1,13 @@
 #include "client.h"
 #include "window.h"
+#include "config.h"
 
 bool Client::OnInit() {
-    crawler = new FileSystemCrawler("/home");
-    trieSearcher.load("/home/a7x/trie.dat");
+    SpotlightConfig config = load_config();
+    for (const auto& layout : shard_layouts(config)) {
+        shards.add(layout);
+    }
+    shards.load();
 
     Window* window = new Window();
     window->Show(true);
@@ -12,12 +16,12 @@ bool Client::OnInit() {
     return true;
 }
 
-std::vector<SQLiteWrapper::FileResult> Client::indexSearch(std::string& query) {
-    return crawler->index_search(query);
+std::vector<SearchResult> Client::search(const std::string &text, int num_results) {
+    return shards.search(text, num_results);
 }
 
-std::vector<FileInfo> Client::trieSearch(std::string &prefix, int num_results) {
-    return trieSearcher.search_prefix_n_results(prefix, num_results);
+void Client::recordOpen(const SearchResult &result) {
+    shards.recordOpen(result);
 }
 
 wxIMPLEMENT_APP(Client);
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include "column_store.h"
+
+#include <algorithm>
+#include <cctype>
+
+uint16_t ColumnStore::intern_extension(const std::string& ext) {
+    std::string key = ext;
+    std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return std::tolower(c); });
+
+    auto it = ext_dictionary.find(key);
+    if (it != ext_dictionary.end()) {
+        return it->second;
+    }
+    // Ids beyond 16 bits share the "unknown" slot; there are never that many
+    // distinct extensions in practice.
+    if (ext_dictionary.size() >= UINT16_MAX) {
+        return NO_EXTENSION;
+    }
+    uint16_t id = static_cast<uint16_t>(ext_dictionary.size() + 1);
+    ext_dictionary.emplace(std::move(key), id);
+    return id;
+}
+
+void ColumnStore::load(const SQLiteWrapper& db) {
+    sizes.clear();
+    mtimes.clear();
+    ext_ids.clear();
+    present.clear();
+    ext_dictionary.clear();
+    cached_key.clear();
+    cached_mask.clear();
+
+    db.scan_metadata([&](int64_t fileid, uint64_t size, int64_t mtime, const char* ext) {
+        if (fileid < 0) {
+            return;
+        }
+        size_t i = static_cast<size_t>(fileid);
+        if (i >= sizes.size()) {
+            size_t n = std::max(i + 1, sizes.size() * 2);
+            sizes.resize(n, 0);
+            mtimes.resize(n, 0);
+            ext_ids.resize(n, NO_EXTENSION);
+            present.resize(n, 0);
+        }
+        sizes[i] = size;
+        mtimes[i] = mtime;
+        ext_ids[i] = intern_extension(ext);
+        present[i] = 1;
+    });
+}
+
+size_t ColumnStore::size() const {
+    return present.size();
+}
+
+uint16_t ColumnStore::extension_id(const std::string& ext) const {
+    auto it = ext_dictionary.find(ext);
+    return it == ext_dictionary.end() ? NO_EXTENSION : it->second;
+}
+
+const std::vector<uint8_t>& ColumnStore::scan(const SearchQuery& query) {
+    std::string key = query.filter_key();
+    if (key == cached_key && cached_mask.size() == present.size()) {
+        return cached_mask;
+    }
+
+    const size_t n = present.size();
+    cached_mask.assign(present.begin(), present.end());
+    uint8_t* mask = cached_mask.data();
+
+    if (query.has_metadata_filters()) {
+        const uint64_t* size = sizes.data();
+        const int64_t* mtime = mtimes.data();
+        const uint64_t min_size = query.min_size, max_size = query.max_size;
+        const int64_t min_mtime = query.min_mtime, max_mtime = query.max_mtime;
+        for (size_t i = 0; i < n; i++) {
+            mask[i] &= static_cast<uint8_t>((size[i] >= min_size) & (size[i] <= max_size) &
+                                            (mtime[i] >= min_mtime) & (mtime[i] <= max_mtime));
+        }
+    }
+
+    if (!query.extensions.empty()) {
+        std::vector<uint8_t> wanted(ext_dictionary.size() + 1, 0);
+        for (const auto& ext : query.extensions) {
+            uint16_t id = extension_id(ext);
+            if (id != NO_EXTENSION) {
+                wanted[id] = 1;
+            }
+        }
+        const uint16_t* ext_id = ext_ids.data();
+        for (size_t i = 0; i < n; i++) {
+            mask[i] &= wanted[ext_id[i]];
+        }
+    }
+
+    cached_key = std::move(key);
+    return cached_mask;
+}
+
+std::vector<int64_t> ColumnStore::first_matches(const std::vector<uint8_t>& mask, size_t n,
+                                                const std::function<bool(int64_t)>& accept) const {
+    std::vector<int64_t> ids;
+    for (size_t i = 0; i < mask.size() && ids.size() < n; i++) {
+        if (mask[i] && (!accept || accept(static_cast<int64_t>(i)))) {
+            ids.push_back(static_cast<int64_t>(i));
+        }
+    }
+    return ids;
+}
@@ -0,0 +1,258 @@
+#include "frecency_store.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char FRECENCY_MAGIC[8] = {'S', 'P', 'F', 'R', 'E', 'C', '\0', '\0'};
+static const uint32_t FRECENCY_VERSION = 1;
+// Slots start on their own cache line.
+static const size_t SLOTS_OFFSET = 64;
+
+static_assert(std::atomic<int64_t>::is_always_lock_free, "slot keys must be lock-free to share across processes");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "slot values must be lock-free to share across processes");
+
+FrecencyStore::~FrecencyStore() {
+    close();
+}
+
+// The score's float bits on top, the minute of the last update below.
+uint64_t FrecencyStore::pack(float score, uint32_t minute) {
+    uint32_t bits;
+    std::memcpy(&bits, &score, sizeof(bits));
+    return static_cast<uint64_t>(bits) << 32 | minute;
+}
+
+double FrecencyStore::decayed(uint64_t value, uint32_t now) {
+    if (value == 0) {
+        return 0.0;
+    }
+    uint32_t bits = static_cast<uint32_t>(value >> 32);
+    float score;
+    std::memcpy(&score, &bits, sizeof(score));
+    uint32_t minute = static_cast<uint32_t>(value);
+    double age = now > minute ? now - minute : 0;
+    return score * std::exp2(-age / HALF_LIFE_MINUTES);
+}
+
+uint32_t FrecencyStore::current_minute() {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::minutes>(now).count());
+}
+
+size_t FrecencyStore::home(int64_t fileid) const {
+    uint64_t x = static_cast<uint64_t>(fileid) * 0x9e3779b97f4a7c15ULL;
+    return (x ^ (x >> 29)) & (CAPACITY - 1);
+}
+
+// Creating or repairing the file happens under flock, so two clients
+// starting together don't both initialise it; after that nothing locks.
+bool FrecencyStore::map_file(const std::string& path, bool create) {
+    size_t bytes = SLOTS_OFFSET + static_cast<size_t>(CAPACITY) * sizeof(Slot);
+    int f = ::open(path.c_str(), create ? (O_RDWR | O_CREAT | O_CLOEXEC) : (O_RDONLY | O_CLOEXEC), 0644);
+    if (f < 0) {
+        return false;
+    }
+
+    if (create) {
+        flock(f, LOCK_EX);
+    }
+
+    struct stat st;
+    bool sized = fstat(f, &st) == 0 && static_cast<size_t>(st.st_size) == bytes;
+    if (!sized && (!create || ftruncate(f, 0) != 0 || ftruncate(f, bytes) != 0)) {
+        ::close(f);
+        return false;
+    }
+
+    void* m = mmap(nullptr, bytes, create ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, f, 0);
+    if (m == MAP_FAILED) {
+        ::close(f);
+        return false;
+    }
+
+    auto* h = static_cast<Header*>(m);
+    bool valid = std::memcmp(h->magic, FRECENCY_MAGIC, sizeof(FRECENCY_MAGIC)) == 0 &&
+                 h->version == FRECENCY_VERSION && h->capacity == CAPACITY;
+    if (!valid && create) {
+        std::memset(m, 0, bytes);
+        std::memcpy(h->magic, FRECENCY_MAGIC, sizeof(FRECENCY_MAGIC));
+        h->version = FRECENCY_VERSION;
+        h->capacity = CAPACITY;
+        valid = true;
+    }
+    if (create) {
+        flock(f, LOCK_UN);
+    }
+    if (!valid) {
+        munmap(m, bytes);
+        ::close(f);
+        return false;
+    }
+
+    fd = f;
+    mapping = m;
+    mapped_bytes = bytes;
+    writable = create;
+    header = h;
+    slots = reinterpret_cast<Slot*>(static_cast<char*>(m) + SLOTS_OFFSET);
+    return true;
+}
+
+bool FrecencyStore::open(const std::string& path) {
+    close();
+    return map_file(path, true) || map_file(path, false);
+}
+
+void FrecencyStore::close() {
+    if (mapping) {
+        munmap(mapping, mapped_bytes);
+        ::close(fd);
+    }
+    fd = -1;
+    mapping = nullptr;
+    mapped_bytes = 0;
+    writable = false;
+    header = nullptr;
+    slots = nullptr;
+}
+
+bool FrecencyStore::is_open() const {
+    return mapping != nullptr;
+}
+
+// Keys are fileid + 1 so zero can mark an empty slot. A full probe window
+// gives its weakest slot to the new file: losing a stale counter only
+// costs a ranking hint. Taking a slot, empty, the file's own or another's,
+// is one CAS from the key seen to the locked key, so two writers can't
+// both take it; a taken slot's value is reset before anyone can read it.
+FrecencyStore::Slot* FrecencyStore::lock_slot(int64_t key, uint32_t now) {
+    size_t start = home(key - 1);
+    for (int attempt = 0; attempt < MAX_LOCK_TRIES; attempt++) {
+        Slot* weakest = nullptr;
+        int64_t weakest_key = 0;
+        double weakest_score = 0.0;
+        bool busy = false;
+        for (size_t probe = 0; probe < MAX_PROBE && !busy; probe++) {
+            Slot& slot = slots[(start + probe) & (CAPACITY - 1)];
+            int64_t existing = slot.key.load(std::memory_order_acquire);
+            if (existing == key || existing == 0) {
+                if (slot.key.compare_exchange_strong(existing, key | LOCKED, std::memory_order_acq_rel)) {
+                    return &slot;
+                }
+                busy = true;
+            } else if (existing == (key | LOCKED)) {
+                busy = true;
+            } else if (!(existing & LOCKED)) {
+                double s = decayed(slot.value.load(std::memory_order_relaxed), now);
+                if (!weakest || s < weakest_score) {
+                    weakest = &slot;
+                    weakest_key = existing;
+                    weakest_score = s;
+                }
+            }
+        }
+
+        if (!busy && weakest &&
+            weakest->key.compare_exchange_strong(weakest_key, key | LOCKED, std::memory_order_acq_rel)) {
+            weakest->value.store(0, std::memory_order_relaxed);
+            return weakest;
+        }
+        std::this_thread::yield();
+    }
+    return nullptr;
+}
+
+void FrecencyStore::record_open(int64_t fileid) {
+    if (!writable || fileid < 0 || fileid + 1 >= LOCKED) {
+        return;
+    }
+
+    int64_t key = fileid + 1;
+    uint32_t now = current_minute();
+    Slot* slot = lock_slot(key, now);
+    if (!slot) {
+        return;
+    }
+    uint64_t old = slot->value.load(std::memory_order_relaxed);
+    slot->value.store(pack(static_cast<float>(decayed(old, now) + 1.0), now), std::memory_order_relaxed);
+    slot->key.store(key, std::memory_order_release);
+    header->updates.fetch_add(1, std::memory_order_release);
+}
+
+// A held slot's value may still be the previous file's, and a key that
+// changed while the value was read may have been handed on: either way
+// the read is retried.
+bool FrecencyStore::read_slot(const Slot& slot, int64_t& key, uint64_t& value) {
+    for (int attempt = 0; attempt < MAX_READ_TRIES; attempt++) {
+        key = slot.key.load(std::memory_order_acquire);
+        value = slot.value.load(std::memory_order_acquire);
+        if (!(key & LOCKED) && slot.key.load(std::memory_order_relaxed) == key) {
+            return true;
+        }
+    }
+    key &= ~LOCKED;
+    return false;
+}
+
+double FrecencyStore::score(int64_t fileid) const {
+    if (!slots || fileid < 0) {
+        return 0.0;
+    }
+
+    int64_t key = fileid + 1;
+    size_t start = home(fileid);
+    for (size_t probe = 0; probe < MAX_PROBE; probe++) {
+        int64_t existing;
+        uint64_t value;
+        bool stable = read_slot(slots[(start + probe) & (CAPACITY - 1)], existing, value);
+        if (existing == key) {
+            return stable ? decayed(value, current_minute()) : 0.0;
+        }
+        if (existing == 0) {
+            break;
+        }
+    }
+    return 0.0;
+}
+
+uint64_t FrecencyStore::version() const {
+    return header ? header->updates.load(std::memory_order_acquire) : 0;
+}
+
+std::vector<std::pair<int64_t, double>> FrecencyStore::top(size_t n) const {
+    std::vector<std::pair<int64_t, double>> entries;
+    if (!slots) {
+        return entries;
+    }
+
+    uint32_t now = current_minute();
+    for (size_t i = 0; i < CAPACITY; i++) {
+        int64_t key;
+        uint64_t value;
+        if (!read_slot(slots[i], key, value) || key <= 0) {
+            continue;
+        }
+        double s = decayed(value, now);
+        if (s > 0.0) {
+            entries.emplace_back(key - 1, s);
+        }
+    }
+
+    auto by_score = [](const auto& a, const auto& b) { return a.second > b.second; };
+    if (entries.size() > n) {
+        std::partial_sort(entries.begin(), entries.begin() + n, entries.end(), by_score);
+        entries.resize(n);
+    } else {
+        std::sort(entries.begin(), entries.end(), by_score);
+    }
+    return entries;
+}
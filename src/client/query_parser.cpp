@@ -0,0 +1,323 @@
+#include "query_parser.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+namespace {
+
+std::string lowercase(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+    return s;
+}
+
+// Reads the leading digits of s into value, failing if there are none or
+// they don't fit in max.
+template <typename T>
+bool parse_count(const std::string& s, size_t& i, T max, T& value) {
+    i = 0;
+    value = 0;
+    while (i < s.size() && std::isdigit(static_cast<unsigned char>(s[i]))) {
+        T digit = s[i] - '0';
+        if (value > (max - digit) / 10) {
+            return false;
+        }
+        value = value * 10 + digit;
+        i++;
+    }
+    return i > 0;
+}
+
+// Sizes that don't fit in 64 bits are rejected rather than wrapped.
+bool parse_size(const std::string& s, uint64_t& out) {
+    size_t i;
+    uint64_t value;
+    if (!parse_count(s, i, std::numeric_limits<uint64_t>::max(), value)) {
+        return false;
+    }
+
+    std::string unit = lowercase(s.substr(i));
+    int shift;
+    if (unit.empty() || unit == "b") {
+        shift = 0;
+    } else if (unit == "k" || unit == "kb") {
+        shift = 10;
+    } else if (unit == "m" || unit == "mb") {
+        shift = 20;
+    } else if (unit == "g" || unit == "gb") {
+        shift = 30;
+    } else if (unit == "t" || unit == "tb") {
+        shift = 40;
+    } else {
+        return false;
+    }
+    if (value > std::numeric_limits<uint64_t>::max() >> shift) {
+        return false;
+    }
+    out = value << shift;
+    return true;
+}
+
+// Relative ages ("7d") come back as a timestamp that many seconds before now.
+bool parse_time(const std::string& s, int64_t now, int64_t& out) {
+    if (s == "today") {
+        std::time_t t = now;
+        std::tm tm{};
+        localtime_r(&t, &tm);
+        tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+        out = std::mktime(&tm);
+        return true;
+    }
+    if (s == "week") {
+        out = now - 7 * 86400;
+        return true;
+    }
+    if (s == "month") {
+        out = now - 30 * 86400;
+        return true;
+    }
+    if (s == "year") {
+        out = now - 365 * 86400;
+        return true;
+    }
+
+    std::tm tm{};
+    std::istringstream date(s);
+    date >> std::get_time(&tm, "%Y-%m-%d");
+    if (!date.fail() && date.peek() == EOF) {
+        tm.tm_isdst = -1;
+        out = std::mktime(&tm);
+        return true;
+    }
+
+    size_t i;
+    int64_t value;
+    if (!parse_count(s, i, std::numeric_limits<int64_t>::max(), value) || i + 1 != s.size()) {
+        return false;
+    }
+
+    int64_t unit;
+    switch (s[i]) {
+        case 'h': unit = 3600; break;
+        case 'd': unit = 86400; break;
+        case 'w': unit = 7 * 86400; break;
+        case 'y': unit = 365 * 86400; break;
+        default: return false;
+    }
+    if (value > now / unit) {
+        return false;
+    }
+    out = now - value * unit;
+    return true;
+}
+
+bool is_relative_age(const std::string& s) {
+    return !s.empty() && std::isalpha(static_cast<unsigned char>(s.back())) && s.find('-') == std::string::npos;
+}
+
+// "7d" but not "today": only a count of units reads as an age.
+bool is_counted_age(const std::string& s) {
+    return is_relative_age(s) && std::isdigit(static_cast<unsigned char>(s[0]));
+}
+
+// Splits "op value" off a filter argument: >, >=, <, <= or a..b range.
+void split_comparison(const std::string& arg, std::string& op, std::string& lo, std::string& hi) {
+    size_t range = arg.find("..");
+    if (range != std::string::npos) {
+        op = "..";
+        lo = arg.substr(0, range);
+        hi = arg.substr(range + 2);
+        return;
+    }
+    size_t n = 0;
+    while (n < arg.size() && n < 2 && (arg[n] == '<' || arg[n] == '>' || arg[n] == '=')) {
+        n++;
+    }
+    op = arg.substr(0, n);
+    lo = arg.substr(n);
+    hi.clear();
+}
+
+bool apply_size(SearchQuery& q, const std::string& arg) {
+    std::string op, lo, hi;
+    split_comparison(arg, op, lo, hi);
+
+    uint64_t a = 0, b = 0;
+    if (op == "..") {
+        if ((!lo.empty() && !parse_size(lo, a)) || (!hi.empty() && !parse_size(hi, b))) {
+            return false;
+        }
+        if (!lo.empty()) q.min_size = std::max(q.min_size, a);
+        if (!hi.empty()) q.max_size = std::min(q.max_size, b);
+        return true;
+    }
+    if (!parse_size(lo, a)) {
+        return false;
+    }
+    if (op == ">") {
+        q.min_size = std::max(q.min_size, a + 1);
+    } else if (op == ">=" || op.empty() || op == "=") {
+        q.min_size = std::max(q.min_size, a);
+        if (op == "=") q.max_size = std::min(q.max_size, a);
+    } else if (op == "<") {
+        q.max_size = std::min(q.max_size, a == 0 ? 0 : a - 1);
+    } else if (op == "<=") {
+        q.max_size = std::min(q.max_size, a);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool apply_modified(SearchQuery& q, const std::string& arg, int64_t now) {
+    std::string op, lo, hi;
+    split_comparison(arg, op, lo, hi);
+
+    // Either end may be an age or a date, and ages run backwards in time, so
+    // "1d..7d", "7d..1d" and "2026-01-01..1d" each mean the span between the
+    // two points whichever way round they are written. An open end keeps
+    // a direction: "7d.." is at least 7 days old, "today.." is since midnight.
+    if (op == "..") {
+        int64_t a, b;
+        if ((!lo.empty() && !parse_time(lo, now, a)) || (!hi.empty() && !parse_time(hi, now, b))) {
+            return false;
+        }
+        if (!lo.empty() && !hi.empty()) {
+            q.min_mtime = std::max(q.min_mtime, std::min(a, b));
+            q.max_mtime = std::min(q.max_mtime, std::max(a, b));
+        } else if (!lo.empty()) {
+            if (is_counted_age(lo)) {
+                q.max_mtime = std::min(q.max_mtime, a);
+            } else {
+                q.min_mtime = std::max(q.min_mtime, a);
+            }
+        } else if (!hi.empty()) {
+            if (is_counted_age(hi)) {
+                q.min_mtime = std::max(q.min_mtime, b);
+            } else {
+                q.max_mtime = std::min(q.max_mtime, b);
+            }
+        }
+        return true;
+    }
+
+    int64_t t;
+    if (!parse_time(lo, now, t)) {
+        return false;
+    }
+
+    // For ages "<7d" means newer than 7 days ago; for dates "<2026-01-01"
+    // means before that date.
+    bool newer = op.empty() || op == "=";
+    if (op == "<" || op == "<=") {
+        newer = is_relative_age(lo);
+    } else if (op == ">" || op == ">=") {
+        newer = !is_relative_age(lo);
+    } else if (!newer) {
+        return false;
+    }
+
+    if (newer) {
+        q.min_mtime = std::max(q.min_mtime, t);
+    } else {
+        q.max_mtime = std::min(q.max_mtime, t);
+    }
+    return true;
+}
+
+// Paths keep their case. "~" is the user's home directory, and a trailing
+// slash is dropped so "in:/usr/" and "in:/usr" are the same scope.
+bool apply_scope(SearchQuery& q, const std::string& arg) {
+    std::string path = arg;
+    if (!path.empty() && path[0] == '~' && (path.size() == 1 || path[1] == '/')) {
+        const char* home = std::getenv("HOME");
+        if (!home) {
+            return false;
+        }
+        path.replace(0, 1, home);
+    }
+    while (path.size() > 1 && path.back() == '/') {
+        path.pop_back();
+    }
+    if (path.empty() || path[0] != '/') {
+        return false;
+    }
+    q.scope = path;
+    return true;
+}
+
+bool apply_ext(SearchQuery& q, const std::string& arg) {
+    std::stringstream ss(arg);
+    std::string ext;
+    bool any = false;
+    while (std::getline(ss, ext, ',')) {
+        if (!ext.empty() && ext[0] == '.') {
+            ext.erase(0, 1);
+        }
+        if (!ext.empty()) {
+            q.extensions.push_back(lowercase(ext));
+            any = true;
+        }
+    }
+    return any;
+}
+
+}
+
+bool SearchQuery::has_filters() const {
+    return !extensions.empty() || !scope.empty() || has_metadata_filters();
+}
+
+bool SearchQuery::has_metadata_filters() const {
+    return min_size != 0 || max_size != std::numeric_limits<uint64_t>::max() ||
+           min_mtime != std::numeric_limits<int64_t>::min() || max_mtime != std::numeric_limits<int64_t>::max();
+}
+
+std::string SearchQuery::filter_key() const {
+    std::ostringstream key;
+    for (const auto& ext : extensions) {
+        key << ext << ',';
+    }
+    key << '|' << min_size << '|' << max_size << '|' << min_mtime << '|' << max_mtime << '|' << scope;
+    return key.str();
+}
+
+SearchQuery parse_query(const std::string& input, int64_t now) {
+    SearchQuery q;
+    std::istringstream words(input);
+    std::string word;
+
+    while (words >> word) {
+        size_t colon = word.find(':');
+        bool consumed = false;
+        if (colon != std::string::npos) {
+            std::string key = lowercase(word.substr(0, colon));
+            std::string arg = lowercase(word.substr(colon + 1));
+            if (key == "ext") {
+                consumed = apply_ext(q, arg);
+            } else if (key == "size") {
+                consumed = apply_size(q, arg);
+            } else if (key == "modified" || key == "mtime") {
+                consumed = apply_modified(q, arg, now);
+            } else if (key == "in") {
+                consumed = apply_scope(q, word.substr(colon + 1));
+            }
+        }
+
+        if (!consumed) {
+            if (!q.text.empty()) {
+                q.text += ' ';
+            }
+            q.text += word;
+        }
+    }
+    return q;
+}
+
+SearchQuery parse_query(const std::string& input) {
+    return parse_query(input, static_cast<int64_t>(std::time(nullptr)));
+}
@@ -39,6 +39,26 @@ int main()
     trie_search(trie_searcher, query);
     std::cout << std::endl;
     std::cout<< "INVERTED INDEX RESULTS "<< std::endl;
-    crawler.index_search(query);
+    // One cursor for the whole listing, so every page comes from the same
+    // snapshot of the database and costs the same however deep it is.
+    SQLiteWrapper::SearchCursor cursor;
+    size_t shown = 0;
+    std::string more = "y";
+    while (more == "y") {
+        std::vector<SQLiteWrapper::FileResult> page = crawler.index_search(query, &cursor);
+        for (const auto &result : page) {
+            std::cout << std::setw(4) << ++shown << ". "
+                      << std::left << std::setw(30) << result.filename
+                      << " | " << result.absolute_path << std::right << "\n";
+        }
+        if (page.empty() || cursor.exhausted) {
+            break;
+        }
+        std::cout << "More results? (y/n) ";
+        std::cin >> more;
+    }
+    if (shown == 0) {
+        std::cout << "No results for '" << query << "'\n";
+    }
     return 0;
 }
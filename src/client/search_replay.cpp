@@ -0,0 +1,259 @@
+// Replays typing against the client's search path without a display and
+// reports per-keystroke latency, so ranking and engine changes can be
+// measured, and held to a budget, outside the wx window.
+//
+//   search_replay [--config FILE | --trie FILE --db FILE [--ext FILE]]
+//                 [--trace FILE | --synthetic N [--seed S]]
+//                 [--results N] [--warmup N]
+//                 [--budget-p95-ms MS] [--budget-p99-ms MS]
+//
+// A trace has one query per line, typed a character at a time; every
+// prefix is one keystroke and one search. Synthetic traces type the first
+// few characters of filenames drawn from the shards' databases. Exits 1
+// when a budget is exceeded.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "shard.h"
+#include "shard_set.h"
+#include "sqlite_wrapper.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct ReplayOptions {
+    std::string configPath;
+    ShardLayout layout;
+    std::string tracePath;
+    size_t synthetic = 0;
+    unsigned seed = 1;
+    int numResults = 10;
+    size_t warmup = 0;
+    double budgetP95 = 0.0;
+    double budgetP99 = 0.0;
+};
+
+static void usage() {
+    std::cerr << "usage: search_replay [--config FILE | --trie FILE --db FILE [--ext FILE]]\n"
+                 "                     [--trace FILE | --synthetic N [--seed S]]\n"
+                 "                     [--results N] [--warmup N]\n"
+                 "                     [--budget-p95-ms MS] [--budget-p99-ms MS]\n";
+}
+
+static bool parseArgs(int argc, char** argv, ReplayOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << arg << " needs a value" << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--config") {
+            options.configPath = value;
+        } else if (arg == "--trie") {
+            options.layout.trie_path = value;
+        } else if (arg == "--db") {
+            options.layout.db_path = value;
+        } else if (arg == "--ext") {
+            options.layout.ext_index_path = value;
+        } else if (arg == "--trace") {
+            options.tracePath = value;
+        } else if (arg == "--synthetic") {
+            options.synthetic = std::strtoul(value.c_str(), nullptr, 10);
+        } else if (arg == "--seed") {
+            options.seed = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+        } else if (arg == "--results") {
+            options.numResults = std::atoi(value.c_str());
+        } else if (arg == "--warmup") {
+            options.warmup = std::strtoul(value.c_str(), nullptr, 10);
+        } else if (arg == "--budget-p95-ms") {
+            options.budgetP95 = std::strtod(value.c_str(), nullptr);
+        } else if (arg == "--budget-p99-ms") {
+            options.budgetP99 = std::strtod(value.c_str(), nullptr);
+        } else {
+            std::cerr << "unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+
+    bool manual = !options.layout.trie_path.empty() || !options.layout.db_path.empty();
+    if (manual == !options.configPath.empty()) {
+        std::cerr << "give either --config or --trie and --db" << std::endl;
+        return false;
+    }
+    if (manual && (options.layout.trie_path.empty() || options.layout.db_path.empty())) {
+        std::cerr << "--trie and --db go together" << std::endl;
+        return false;
+    }
+    if (options.tracePath.empty() == (options.synthetic == 0)) {
+        std::cerr << "give either --trace or --synthetic" << std::endl;
+        return false;
+    }
+    return options.numResults > 0;
+}
+
+static std::vector<std::string> readTrace(const std::string& path) {
+    std::vector<std::string> queries;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty()) {
+            queries.push_back(line);
+        }
+    }
+    return queries;
+}
+
+// Filenames are sampled from every shard with a fixed seed, so a trace can
+// be regenerated exactly; each query is two to six characters of one.
+static std::vector<std::string> syntheticTrace(const std::vector<ShardLayout>& layouts, size_t count,
+                                               unsigned seed) {
+    std::vector<std::string> names;
+    for (const auto& layout : layouts) {
+        SQLiteWrapper db(layout.db_path, true);
+        db.scan_paths([&names](int64_t, const char* path) {
+            std::string name = path;
+            size_t slash = name.find_last_of('/');
+            if (slash != std::string::npos) {
+                name.erase(0, slash + 1);
+            }
+            if (!name.empty()) {
+                names.push_back(name);
+            }
+        });
+    }
+
+    std::vector<std::string> queries;
+    if (names.empty()) {
+        return queries;
+    }
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<size_t> pick(0, names.size() - 1);
+    std::uniform_int_distribution<size_t> length(2, 6);
+    for (size_t i = 0; i < count; i++) {
+        const std::string& name = names[pick(rng)];
+        queries.push_back(name.substr(0, std::min(name.size(), length(rng))));
+    }
+    return queries;
+}
+
+// Nearest-rank percentile of sorted samples.
+static double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t rank = static_cast<size_t>(p / 100.0 * sorted.size() + 0.999999);
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+struct Percentiles {
+    double p50, p95, p99, max;
+};
+
+static Percentiles summarize(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    return {percentile(samples, 50), percentile(samples, 95), percentile(samples, 99),
+            samples.empty() ? 0.0 : samples.back()};
+}
+
+static void printRow(const std::string& label, const Percentiles& p) {
+    std::cout << std::left << std::setw(10) << label << std::right << std::fixed << std::setprecision(3)
+              << std::setw(10) << p.p50 << std::setw(10) << p.p95 << std::setw(10) << p.p99
+              << std::setw(10) << p.max << "\n";
+}
+
+int main(int argc, char** argv) {
+    ReplayOptions options;
+    if (!parseArgs(argc, argv, options)) {
+        usage();
+        return 2;
+    }
+
+    std::vector<ShardLayout> layouts;
+    if (!options.configPath.empty()) {
+        layouts = shard_layouts(load_config(options.configPath));
+    } else {
+        options.layout.name = "replay";
+        layouts.push_back(options.layout);
+    }
+    if (layouts.empty()) {
+        std::cerr << "no shards to search" << std::endl;
+        return 2;
+    }
+
+    // Frecency is left out: replayed keystrokes never open anything, and a
+    // user's open counts would make runs incomparable.
+    ShardSet shards;
+    for (auto layout : layouts) {
+        layout.frecency_path.clear();
+        shards.add(layout);
+    }
+    Clock::time_point loadStart = Clock::now();
+    shards.load();
+    double loadMs = std::chrono::duration<double, std::milli>(Clock::now() - loadStart).count();
+
+    std::vector<std::string> queries = options.tracePath.empty()
+                                           ? syntheticTrace(layouts, options.synthetic, options.seed)
+                                           : readTrace(options.tracePath);
+    if (queries.empty()) {
+        std::cerr << "trace is empty" << std::endl;
+        return 2;
+    }
+
+    std::vector<double> total, trie, fts, content, assembly;
+    size_t returned = 0;
+    for (size_t q = 0; q < queries.size() + options.warmup; q++) {
+        const std::string& query = queries[q % queries.size()];
+        bool measured = q >= options.warmup;
+        for (size_t typed = 1; typed <= query.size(); typed++) {
+            SearchTiming timing;
+            Clock::time_point start = Clock::now();
+            std::vector<SearchResult> results = shards.search(query.substr(0, typed), options.numResults, &timing);
+            double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            if (!measured) {
+                continue;
+            }
+            total.push_back(elapsed);
+            trie.push_back(timing.trie_ms);
+            fts.push_back(timing.fts_ms);
+            content.push_back(timing.content_ms);
+            assembly.push_back(timing.assembly_ms);
+            returned += results.size();
+        }
+    }
+
+    Percentiles overall = summarize(total);
+    std::cout << shards.size() << " shard(s) loaded in " << std::fixed << std::setprecision(1) << loadMs
+              << " ms; " << queries.size() << " queries, " << total.size() << " keystrokes, "
+              << returned << " results\n\n";
+    std::cout << std::left << std::setw(10) << "ms" << std::right << std::setw(10) << "p50" << std::setw(10)
+              << "p95" << std::setw(10) << "p99" << std::setw(10) << "max" << "\n";
+    printRow("total", overall);
+    printRow("trie", summarize(trie));
+    printRow("fts", summarize(fts));
+    printRow("content", summarize(content));
+    printRow("assembly", summarize(assembly));
+    std::cout.flush();
+
+    bool failed = false;
+    if (options.budgetP95 > 0.0 && overall.p95 > options.budgetP95) {
+        std::cerr << "p95 " << overall.p95 << " ms exceeds budget of " << options.budgetP95 << " ms" << std::endl;
+        failed = true;
+    }
+    if (options.budgetP99 > 0.0 && overall.p99 > options.budgetP99) {
+        std::cerr << "p99 " << overall.p99 << " ms exceeds budget of " << options.budgetP99 << " ms" << std::endl;
+        failed = true;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,93 @@
+#include "search_result.h"
+
+#include <algorithm>
+
+TopKMerger::TopKMerger(size_t k) : k(k) {
+    heap.reserve(k);
+}
+
+const std::string& TopKMerger::key(const SearchResult& r) {
+    return r.absolute_path;
+}
+
+// Ties go to the shorter name, then the shorter path.
+bool TopKMerger::better(const SearchResult& a, const SearchResult& b) {
+    if (a.score != b.score) {
+        return a.score > b.score;
+    }
+    if (a.filename.size() != b.filename.size()) {
+        return a.filename.size() < b.filename.size();
+    }
+    return a.absolute_path < b.absolute_path;
+}
+
+void TopKMerger::swap_entries(size_t a, size_t b) {
+    std::swap(heap[a], heap[b]);
+    positions[key(heap[a])] = a;
+    positions[key(heap[b])] = b;
+}
+
+// heap[0] is the worst of the kept results.
+void TopKMerger::sift_up(size_t i) {
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!better(heap[parent], heap[i])) {
+            break;
+        }
+        swap_entries(i, parent);
+        i = parent;
+    }
+}
+
+void TopKMerger::sift_down(size_t i) {
+    while (true) {
+        size_t worst = i;
+        size_t l = 2 * i + 1, r = 2 * i + 2;
+        if (l < heap.size() && better(heap[worst], heap[l])) worst = l;
+        if (r < heap.size() && better(heap[worst], heap[r])) worst = r;
+        if (worst == i) {
+            break;
+        }
+        swap_entries(i, worst);
+        i = worst;
+    }
+}
+
+void TopKMerger::add(SearchResult result) {
+    if (k == 0) {
+        return;
+    }
+
+    auto it = positions.find(key(result));
+    if (it != positions.end()) {
+        size_t i = it->second;
+        if (result.score > heap[i].score) {
+            heap[i] = std::move(result);
+            sift_down(i);
+        }
+        return;
+    }
+
+    if (heap.size() < k) {
+        positions[key(result)] = heap.size();
+        heap.push_back(std::move(result));
+        sift_up(heap.size() - 1);
+        return;
+    }
+
+    if (!better(result, heap[0])) {
+        return;
+    }
+    positions.erase(key(heap[0]));
+    positions[key(result)] = 0;
+    heap[0] = std::move(result);
+    sift_down(0);
+}
+
+std::vector<SearchResult> TopKMerger::take() {
+    std::vector<SearchResult> out = std::move(heap);
+    heap.clear();
+    positions.clear();
+    std::sort(out.begin(), out.end(), better);
+    return out;
+}
@@ -0,0 +1,514 @@
+#include "shard_searcher.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <unordered_map>
+
+#include <sys/stat.h>
+
+#include "file_crawler.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double millisSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+ShardSearcher::ShardSearcher(const ShardLayout& layout)
+    : layout(layout), db(layout.db_path, true), snapshot(std::make_unique<Snapshot>()) {
+}
+
+std::unique_ptr<ShardSearcher::Snapshot> ShardSearcher::loadSnapshot(const ShardLayout& layout,
+                                                                     const SnapshotStamp& stamp) {
+    auto loaded = std::make_unique<Snapshot>();
+    loaded->trieSearcher.load(layout.trie_path);
+    loaded->columns.load(SQLiteWrapper(layout.db_path, true));
+    loaded->extensionIndex.load(layout.ext_index_path);
+    loaded->tokenIndex.load(layout.token_index_path);
+    loaded->directoryIndex.load(layout.dir_index_path);
+    loaded->prefixTable.load(layout.prefix_table_path);
+    loaded->databaseId = stamp.database_id;
+    return loaded;
+}
+
+// The stamp is read before the files, so a save landing mid-load is
+// picked up by the next refresh. Snapshots saved from another database
+// are left unloaded until the indexer publishes ones matching this one.
+void ShardSearcher::load() {
+    databaseReplaced();
+    SnapshotStamp stamp;
+    read_snapshot_stamp(layout, stamp);
+    snapshotGeneration = stamp.generation;
+    if (stamp.database_id == databaseId) {
+        snapshot = loadSnapshot(layout, stamp);
+    } else {
+        if (stamp.generation != 0) {
+            std::cerr << "Snapshot of " << layout.directory << " is from another database, "
+                      << "waiting for the indexer to rewrite it" << std::endl;
+        }
+        snapshot->columns.load(db);
+    }
+    frecency.open(layout.frecency_path);
+}
+
+// A rebuild deletes the database and creates a new one at the same path,
+// which may well reuse the old inode number; its status change time is
+// new either way. That time also moves when a checkpoint writes the file,
+// which just costs an extra read of the id.
+bool ShardSearcher::databaseReplaced() {
+    struct stat st;
+    if (::stat(layout.db_path.c_str(), &st) != 0) {
+        return false;
+    }
+    int64_t changed = static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec;
+    if (static_cast<uint64_t>(st.st_dev) == databaseDevice && static_cast<uint64_t>(st.st_ino) == databaseInode &&
+        changed == databaseChanged) {
+        return false;
+    }
+    databaseDevice = st.st_dev;
+    databaseInode = st.st_ino;
+    databaseChanged = changed;
+    std::string id = db.database_id();
+    if (id == databaseId) {
+        return false;
+    }
+    databaseId = id;
+    return true;
+}
+
+// Checked at the start of every search. Loading a large trie takes
+// seconds, so until the newer files are read searches keep using the old
+// ones rather than waiting. Once the database has been replaced they can't
+// be used at all: every fileid they and the open counts hold now names a
+// different file, if any.
+void ShardSearcher::refreshSnapshot() {
+    if (databaseReplaced()) {
+        snapshot = std::make_unique<Snapshot>();
+        snapshot->columns.load(db);
+        cachedExtensionKey.clear();
+        cachedScope.clear();
+        frecency.close();
+        frecency.open(layout.frecency_path);
+        hotFiles.clear();
+        hotVersion = UINT64_MAX;
+    }
+
+    if (nextSnapshot.valid()) {
+        if (nextSnapshot.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return;
+        }
+        std::unique_ptr<Snapshot> loaded = nextSnapshot.get();
+        if (loaded->databaseId == databaseId) {
+            snapshot = std::move(loaded);
+            cachedExtensionKey.clear();
+            cachedScope.clear();
+        }
+        return;
+    }
+
+    SnapshotStamp stamp;
+    if (!read_snapshot_stamp(layout, stamp) || stamp.generation == snapshotGeneration) {
+        return;
+    }
+    snapshotGeneration = stamp.generation;
+    if (stamp.database_id == databaseId) {
+        nextSnapshot = std::async(std::launch::async, [layout = layout, stamp] { return loadSnapshot(layout, stamp); });
+    }
+}
+
+void ShardSearcher::recordOpen(int64_t fileid) {
+    frecency.record_open(fileid);
+}
+
+const ShardLayout& ShardSearcher::getLayout() const {
+    return layout;
+}
+
+// ext: is answered from the per-extension bitmaps when the indexer has
+// written them; otherwise the column store's extension ids are scanned.
+const RoaringBitmap* ShardSearcher::extensionFilter(const SearchQuery& query) {
+    if (query.extensions.empty() || snapshot->extensionIndex.empty()) {
+        return nullptr;
+    }
+
+    std::string key;
+    for (const auto& ext : query.extensions) {
+        key += ext + ',';
+    }
+    if (key != cachedExtensionKey) {
+        cachedExtensionBitmap = snapshot->extensionIndex.match_any(query.extensions);
+        cachedExtensionKey = key;
+    }
+    return &cachedExtensionBitmap;
+}
+
+// Until the indexer has written a directory index, in: is answered from
+// the database's path index instead: the fileids under the scope are
+// collected once per scope and snapshot.
+const RoaringBitmap* ShardSearcher::scopeFallback(const SearchQuery& query) {
+    if (query.scope.empty() || !snapshot->directoryIndex.empty()) {
+        return nullptr;
+    }
+    if (query.scope != cachedScope) {
+        std::cerr << "No directory index for " << layout.directory << ", matching in:" << query.scope
+                  << " by path" << std::endl;
+        cachedScopeBitmap = RoaringBitmap();
+        db.scan_scope(query.scope, [&](int64_t fileid) {
+            if (fileid >= 0 && fileid <= UINT32_MAX) {
+                cachedScopeBitmap.add(static_cast<uint32_t>(fileid));
+            }
+        });
+        cachedScope = query.scope;
+    }
+    return &cachedScopeBitmap;
+}
+
+// A scope naming no directory of this shard rules the whole shard out
+// before any engine runs.
+bool ShardSearcher::outOfScope(const SearchQuery& query) {
+    if (query.scope.empty()) {
+        return false;
+    }
+    if (const RoaringBitmap* under = scopeFallback(query)) {
+        return under->empty();
+    }
+    DirectoryIndex::Interval scope;
+    return !snapshot->directoryIndex.find(query.scope, scope);
+}
+
+// in: costs two integer comparisons per candidate against the directory's
+// interval, or a bitmap probe without a directory index.
+std::function<bool(int64_t)> ShardSearcher::buildFilter(const SearchQuery& query) {
+    const RoaringBitmap* allowed = extensionFilter(query);
+    const RoaringBitmap* under = scopeFallback(query);
+
+    const DirectoryIndex* directories = nullptr;
+    DirectoryIndex::Interval scope;
+    if (!query.scope.empty() && !under) {
+        snapshot->directoryIndex.find(query.scope, scope);
+        directories = &snapshot->directoryIndex;
+    }
+
+    SearchQuery remaining = query;
+    remaining.scope.clear();
+    if (allowed) {
+        remaining.extensions.clear();
+    }
+    const std::vector<uint8_t>* mask = remaining.has_filters() ? &snapshot->columns.scan(remaining) : nullptr;
+
+    return [allowed, under, directories, scope, mask](int64_t fileid) {
+        if (fileid < 0 || fileid > UINT32_MAX) {
+            return false;
+        }
+        if (directories && !directories->contains(scope, fileid)) {
+            return false;
+        }
+        if (under && !under->contains(static_cast<uint32_t>(fileid))) {
+            return false;
+        }
+        if (allowed && !allowed->contains(static_cast<uint32_t>(fileid))) {
+            return false;
+        }
+        return !mask || (static_cast<size_t>(fileid) < mask->size() && (*mask)[fileid]);
+    };
+}
+
+// Path tokens are matched in the indexer's saved postings when it has
+// written them, SQLite only supplying the rows of the winners; fts_index
+// is the fallback until then. Every query token is taken as a prefix.
+std::vector<SQLiteWrapper::FileResult> ShardSearcher::indexSearch(const SearchQuery& query,
+                                                                  const std::function<bool(int64_t)>& accept) {
+    if (query.text.empty()) {
+        return {};
+    }
+    if (snapshot->tokenIndex.empty()) {
+        return db.search(query.text, SEARCH_LIMIT, nullptr, accept);
+    }
+
+    std::unordered_set<std::string> tokens = tokenize(query.text);
+    std::vector<TokenIndex::Match> matches =
+        snapshot->tokenIndex.search(std::vector<std::string>(tokens.begin(), tokens.end()), SEARCH_LIMIT, accept);
+
+    std::vector<int64_t> ids;
+    std::unordered_map<int64_t, double> ranks;
+    for (const auto& match : matches) {
+        ids.push_back(match.fileid);
+        ranks[match.fileid] = match.rank;
+    }
+    std::vector<SQLiteWrapper::FileResult> rows = db.get_files(ids);
+    for (auto& row : rows) {
+        row.rank = ranks[row.fileid];
+    }
+    return rows;
+}
+
+std::vector<SQLiteWrapper::FileResult> ShardSearcher::contentSearch(const SearchQuery& query,
+                                                                    const std::function<bool(int64_t)>& accept) {
+    if (query.text.empty()) {
+        return {};
+    }
+    return db.search_content(query.text, SEARCH_LIMIT, nullptr, accept);
+}
+
+// A plain query of up to PrefixTable::MAX_PREFIX characters is read from
+// the indexer's table instead of walking the trie and expanding tokens. It
+// has to be one token as the index splits text, so "aB" or "a.b" still go
+// to the engines; only the rows of the listed files come from SQLite.
+bool ShardSearcher::precomputedSearch(const SearchQuery& query, int num_results, std::vector<FileInfo>& names,
+                                      std::vector<SQLiteWrapper::FileResult>& tokens) {
+    if (static_cast<size_t>(num_results) > PrefixTable::TOP_K || query.text.size() > PrefixTable::MAX_PREFIX) {
+        return false;
+    }
+    std::unordered_set<std::string> queryTokens = tokenize(query.text);
+    if (queryTokens.size() != 1 || queryTokens.begin()->size() != query.text.size()) {
+        return false;
+    }
+
+    std::vector<int64_t> nameIds;
+    std::vector<TokenIndex::Match> matches;
+    if (!snapshot->prefixTable.lookup(query.text, nameIds, matches)) {
+        return false;
+    }
+    nameIds.resize(std::min(nameIds.size(), static_cast<size_t>(num_results)));
+    matches.resize(std::min(matches.size(), static_cast<size_t>(SEARCH_LIMIT)));
+
+    std::vector<int64_t> ids = nameIds;
+    for (const auto& match : matches) {
+        ids.push_back(match.fileid);
+    }
+    std::unordered_map<int64_t, SQLiteWrapper::FileResult> rows;
+    for (auto& row : db.get_files(ids)) {
+        rows.emplace(row.fileid, std::move(row));
+    }
+    for (int64_t fileid : nameIds) {
+        auto row = rows.find(fileid);
+        if (row != rows.end()) {
+            names.emplace_back(row->second.filename, row->second.absolute_path, row->second.extension, fileid);
+        }
+    }
+    for (const auto& match : matches) {
+        auto row = rows.find(match.fileid);
+        if (row != rows.end()) {
+            tokens.push_back(row->second);
+            tokens.back().rank = match.rank;
+        }
+    }
+    return true;
+}
+
+std::vector<FileInfo> ShardSearcher::trieSearch(const SearchQuery& query, int num_results,
+                                                const std::function<bool(int64_t)>& accept) {
+    if (!accept) {
+        return snapshot->trieSearcher.search_prefix_n_results(query.text, num_results);
+    }
+
+    // Filter-only queries have no prefix to walk; enumerate the extension
+    // bitmap (or the metadata mask) directly.
+    if (query.text.empty()) {
+        std::vector<int64_t> ids;
+        if (const RoaringBitmap* allowed = extensionFilter(query)) {
+            allowed->for_each([&](uint32_t fileid) {
+                if (accept(fileid)) {
+                    ids.push_back(fileid);
+                }
+                return ids.size() < static_cast<size_t>(num_results);
+            });
+        } else {
+            ids = snapshot->columns.first_matches(snapshot->columns.scan(query), num_results, accept);
+        }
+
+        std::vector<FileInfo> results;
+        for (auto& row : db.get_files(ids)) {
+            results.emplace_back(row.filename, row.absolute_path, row.extension, row.fileid);
+        }
+        return results;
+    }
+
+    return snapshot->trieSearcher.search_prefix_n_results(query.text, num_results, [&](const FileInfo& info) {
+        return accept(info.fileid);
+    });
+}
+
+// A typo costs an edit per character it breaks, so short queries would
+// match almost anything at distance 2; the allowance grows with length.
+static int fuzzyDistance(const std::string& text) {
+    if (text.size() < 4) {
+        return 0;
+    }
+    return text.size() < 8 ? 1 : 2;
+}
+
+// Only asked when the exact prefix walk came up short.
+std::vector<FuzzyMatch> ShardSearcher::fuzzySearch(const SearchQuery& query, int num_results,
+                                                   const std::function<bool(int64_t)>& accept) {
+    int distance = fuzzyDistance(query.text);
+    if (distance == 0) {
+        return {};
+    }
+    if (!accept) {
+        return snapshot->trieSearcher.search_fuzzy_n_results(query.text, distance, num_results);
+    }
+    return snapshot->trieSearcher.search_fuzzy_n_results(query.text, distance, num_results, [&](const FileInfo& info) {
+        return accept(info.fileid);
+    });
+}
+
+// Name matches score by how much of the filename the query covers; FTS
+// matches map bm25 (lower is better, <= 0) into the range below them, with
+// hits inside file contents ranked under hits in the path.
+static double trieScore(const std::string& query, const FileInfo& info) {
+    if (info.filename.empty()) {
+        return 0.6;
+    }
+    double coverage = std::min(1.0, static_cast<double>(query.size()) / info.filename.size());
+    return 0.6 + 0.4 * coverage;
+}
+
+// Near misses rank by distance first, each edit a band lower, then by
+// coverage; even one edit puts a name under every exact one.
+static double fuzzyScore(const std::string& query, const FuzzyMatch& match) {
+    double coverage = trieScore(query, match.info) - 0.6;
+    return 0.55 - 0.1 * match.distance + 0.1 * coverage;
+}
+
+static double ftsScore(double bm25, double ceiling) {
+    double relevance = std::max(0.0, -bm25);
+    return ceiling * relevance / (1.0 + relevance);
+}
+
+// Two recent opens are worth half the boost; it approaches 0.5 for files
+// opened all the time, enough to lift a weak name match over a strong one.
+double ShardSearcher::frecencyBoost(int64_t fileid) const {
+    double opens = frecency.score(fileid);
+    return 0.5 * opens / (opens + 2.0);
+}
+
+// The engines return their first few matches by their own order, which a
+// short prefix can fill without reaching the files the user actually opens.
+// The most-opened files are checked against the prefix directly; their
+// names are fetched once per change to the store.
+std::vector<SQLiteWrapper::FileResult> ShardSearcher::hotSearch(const SearchQuery& query,
+                                                                const std::function<bool(int64_t)>& accept) {
+    if (!frecency.is_open() || query.text.empty()) {
+        return {};
+    }
+
+    uint64_t version = frecency.version();
+    if (version != hotVersion) {
+        std::vector<int64_t> ids;
+        for (const auto& [fileid, score] : frecency.top(HOT_FILES)) {
+            ids.push_back(fileid);
+        }
+        hotFiles = db.get_files(ids);
+        hotVersion = version;
+    }
+
+    auto lower = [](unsigned char c) { return static_cast<char>(std::tolower(c)); };
+    std::vector<SQLiteWrapper::FileResult> matches;
+    for (const auto& file : hotFiles) {
+        if (file.filename.size() < query.text.size()) {
+            continue;
+        }
+        bool prefix = std::equal(query.text.begin(), query.text.end(), file.filename.begin(),
+                                 [&](char a, char b) { return lower(a) == lower(b); });
+        if (prefix && (!accept || accept(file.fileid))) {
+            matches.push_back(file);
+        }
+    }
+    return matches;
+}
+
+// All engines run at once, so a query costs the slowest of them rather
+// than their sum. The filter is built up front because its caches aren't
+// safe to fill from two threads. A short prefix answered from the prefix
+// table skips the trie and token engines, and the content index too when
+// the table fills the page: content hits all score under name matches.
+std::vector<SearchResult> ShardSearcher::search(const SearchQuery& query, int num_results, SearchTiming* timing) {
+    Clock::time_point start = Clock::now();
+    refreshSnapshot();
+    if (outOfScope(query)) {
+        return {};
+    }
+    std::function<bool(int64_t)> accept = query.has_filters() ? buildFilter(query) : nullptr;
+    double filterMs = millisSince(start);
+
+    Clock::time_point trieStart = Clock::now();
+    std::vector<FileInfo> trieResults;
+    std::vector<SQLiteWrapper::FileResult> indexResults;
+    bool precomputed = !accept && precomputedSearch(query, num_results, trieResults, indexResults);
+    double lookupMs = millisSince(trieStart);
+
+    double ftsMs = 0.0, contentMs = 0.0;
+    std::future<std::vector<SQLiteWrapper::FileResult>> fts, content;
+    if (!precomputed) {
+        fts = std::async(std::launch::async, [&] {
+            Clock::time_point t = Clock::now();
+            auto rows = indexSearch(query, accept);
+            ftsMs = millisSince(t);
+            return rows;
+        });
+    }
+    if (!precomputed || trieResults.size() < static_cast<size_t>(num_results)) {
+        content = std::async(std::launch::async, [&] {
+            Clock::time_point t = Clock::now();
+            auto rows = contentSearch(query, accept);
+            contentMs = millisSince(t);
+            return rows;
+        });
+    }
+    trieStart = Clock::now();
+    std::vector<FuzzyMatch> fuzzyResults;
+    if (!precomputed) {
+        trieResults = trieSearch(query, num_results, accept);
+        if (trieResults.size() < static_cast<size_t>(num_results)) {
+            fuzzyResults = fuzzySearch(query, num_results, accept);
+        }
+    }
+    std::vector<SQLiteWrapper::FileResult> hotResults = hotSearch(query, accept);
+    double trieMs = lookupMs + millisSince(trieStart);
+    if (fts.valid()) {
+        indexResults = fts.get();
+    }
+    std::vector<SQLiteWrapper::FileResult> contentResults;
+    if (content.valid()) {
+        contentResults = content.get();
+    }
+
+    Clock::time_point mergeStart = Clock::now();
+    TopKMerger merger(num_results);
+    auto add = [&](const std::string& filename, const std::string& path, const std::string& ext, int64_t fileid,
+                   double score) {
+        merger.add({filename, path, ext, fileid, score + frecencyBoost(fileid)});
+    };
+    for (const auto& info : trieResults) {
+        add(info.filename, info.absolute_path, info.extension, info.fileid, trieScore(query.text, info));
+    }
+    for (const auto& match : fuzzyResults) {
+        if (match.distance > 0) {
+            add(match.info.filename, match.info.absolute_path, match.info.extension, match.info.fileid,
+                fuzzyScore(query.text, match));
+        }
+    }
+    for (const auto& row : hotResults) {
+        add(row.filename, row.absolute_path, row.extension, row.fileid,
+            trieScore(query.text, FileInfo(row.filename, row.absolute_path, row.extension, row.fileid)));
+    }
+    for (const auto& row : indexResults) {
+        add(row.filename, row.absolute_path, row.extension, row.fileid, ftsScore(row.rank, 0.5));
+    }
+    for (const auto& row : contentResults) {
+        add(row.filename, row.absolute_path, row.extension, row.fileid, ftsScore(row.rank, 0.4));
+    }
+    std::vector<SearchResult> merged = merger.take();
+
+    if (timing) {
+        timing->trie_ms = trieMs;
+        timing->fts_ms = ftsMs;
+        timing->content_ms = contentMs;
+        timing->assembly_ms = filterMs + millisSince(mergeStart);
+    }
+    return merged;
+}
@@ -0,0 +1,88 @@
+#include "shard_set.h"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+
+using Clock = std::chrono::steady_clock;
+
+static double millisSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void ShardSet::add(const ShardLayout& layout) {
+    shards.push_back(std::make_unique<ShardSearcher>(layout));
+}
+
+void ShardSet::load() {
+    std::vector<std::future<void>> loading;
+    for (auto& shard : shards) {
+        loading.push_back(std::async(std::launch::async, [&shard] { shard->load(); }));
+    }
+    for (auto& done : loading) {
+        done.get();
+    }
+}
+
+size_t ShardSet::size() const {
+    return shards.size();
+}
+
+// Every shard is queried at once and their top results merged, so a query
+// costs the slowest shard rather than the sum of all of them. For the same
+// reason an engine's time is the slowest shard's; parsing and both merges
+// count as assembly.
+std::vector<SearchResult> ShardSet::search(const std::string& text, int num_results, SearchTiming* timing) {
+    Clock::time_point start = Clock::now();
+    SearchQuery query = parse_query(text);
+    if (query.text.empty() && !query.has_filters()) {
+        return {};
+    }
+    double parseMs = millisSince(start);
+
+    std::vector<SearchTiming> shardTimings(shards.size());
+    std::vector<std::future<std::vector<SearchResult>>> pending;
+    for (size_t i = 0; i < shards.size(); i++) {
+        pending.push_back(std::async(std::launch::async, [this, i, &query, num_results, &shardTimings, timing] {
+            std::vector<SearchResult> results =
+                shards[i]->search(query, num_results, timing ? &shardTimings[i] : nullptr);
+            for (auto& result : results) {
+                result.shard = static_cast<int>(i);
+            }
+            return results;
+        }));
+    }
+
+    std::vector<std::vector<SearchResult>> shardResults;
+    for (auto& results : pending) {
+        shardResults.push_back(results.get());
+    }
+
+    Clock::time_point mergeStart = Clock::now();
+    TopKMerger merger(num_results);
+    for (auto& results : shardResults) {
+        for (auto& result : results) {
+            merger.add(std::move(result));
+        }
+    }
+    std::vector<SearchResult> merged = merger.take();
+
+    if (timing) {
+        *timing = SearchTiming();
+        double slowestAssembly = 0.0;
+        for (const auto& t : shardTimings) {
+            timing->trie_ms = std::max(timing->trie_ms, t.trie_ms);
+            timing->fts_ms = std::max(timing->fts_ms, t.fts_ms);
+            timing->content_ms = std::max(timing->content_ms, t.content_ms);
+            slowestAssembly = std::max(slowestAssembly, t.assembly_ms);
+        }
+        timing->assembly_ms = parseMs + slowestAssembly + millisSince(mergeStart);
+    }
+    return merged;
+}
+
+void ShardSet::recordOpen(const SearchResult& result) {
+    if (result.shard >= 0 && static_cast<size_t>(result.shard) < shards.size()) {
+        shards[result.shard]->recordOpen(result.fileid);
+    }
+}
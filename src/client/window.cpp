@@ -1,5 +1,4 @@
 #include "window.h"
-#include <unordered_set>
 
 Window::Window()
     : wxFrame(nullptr, wxID_ANY, wxT("Spotlight"), wxDefaultPosition, wxDefaultSize, wxDEFAULT_FRAME_STYLE & ~(wxRESIZE_BORDER | wxMAXIMIZE_BOX))
@@ -39,10 +38,9 @@ void Window::onTextInput(wxCommandEvent &event) {
     resultsSizer->Clear(true);
 
     bool hasResults = false;
-    std::unordered_set<std::string> seenPaths;
 
-    // Helper lambda to add results
-    auto addResult = [&](const std::string& filename, const std::string& absolute_path) {
+    // Helper lambda to add results; clicking anywhere on a cell opens it
+    auto addResult = [&](size_t index, const std::string& filename, const std::string& absolute_path) {
         wxPanel* cell = new wxPanel(scrollableOutput, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxBORDER_SIMPLE);
         wxBoxSizer* cellSizer = new wxBoxSizer(wxVERTICAL);
 
@@ -61,24 +59,16 @@ void Window::onTextInput(wxCommandEvent &event) {
         cell->SetSizer(cellSizer);
         resultsSizer->Add(cell, 0, wxALL | wxEXPAND, 3);
         hasResults = true;
-    };
 
-    if (!query.empty()) {
-        auto trieResults = searchClient->trieSearch(query);
-        for (const auto& res : trieResults) {
-            if (seenPaths.find(res.absolute_path) == seenPaths.end()) {
-                addResult(res.filename, res.absolute_path);
-                seenPaths.insert(res.absolute_path);
-            }
+        for (wxWindow* target : {static_cast<wxWindow*>(cell), static_cast<wxWindow*>(nameLabel),
+                                 static_cast<wxWindow*>(pathLabel)}) {
+            target->Bind(wxEVT_LEFT_UP, [this, index](wxMouseEvent&) { openResult(index); });
         }
+    };
 
-        auto indexResults = searchClient->indexSearch(query);
-        for (const auto& res : indexResults) {
-            if (seenPaths.find(res.absolute_path) == seenPaths.end()) {
-                addResult(res.filename, res.absolute_path);
-                seenPaths.insert(res.absolute_path);
-            }
-        }
+    results = searchClient->search(query);
+    for (size_t i = 0; i < results.size(); i++) {
+        addResult(i, results[i].filename, results[i].absolute_path);
     }
 
     if (hasResults) {
@@ -93,6 +83,16 @@ void Window::onTextInput(wxCommandEvent &event) {
     panel->GetSizer()->Fit(this);
 }
 
+void Window::openResult(size_t index) {
+    if (index >= results.size()) {
+        return;
+    }
+    const SearchResult& result = results[index];
+    if (wxLaunchDefaultApplication(wxString(result.absolute_path))) {
+        searchClient->recordOpen(result);
+    }
+}
+
 void Window::onSyncClicked(wxCommandEvent& event) {
     // system("/usr/local/bin/indexer");
     // to do
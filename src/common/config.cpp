@@ -0,0 +1,158 @@
+#include "config.h"
+
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+namespace
+{
+std::string trim(const std::string &s)
+{
+    size_t begin = s.find_first_not_of(" \t\r");
+    if (begin == std::string::npos)
+        return "";
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+}
+
+// A whole, non-negative number and nothing else: stoull alone takes "-1"
+// as a huge value and "12abc" as 12. Settings in KB or MB pass the shift
+// that turns them into bytes, which must not overflow.
+bool parse_size(const std::string &value, size_t &out, unsigned shift = 0)
+{
+    if (value.empty() || !std::isdigit(static_cast<unsigned char>(value[0])))
+        return false;
+    try
+    {
+        size_t used = 0;
+        unsigned long long parsed = std::stoull(value, &used);
+        if (used != value.size() || parsed > (std::numeric_limits<size_t>::max() >> shift))
+            return false;
+        out = static_cast<size_t>(parsed);
+        return true;
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+}
+
+bool parse_list(const std::string &value, std::vector<std::string> &out, bool allow_empty = false)
+{
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start <= value.size())
+    {
+        size_t comma = value.find(',', start);
+        if (comma == std::string::npos)
+            comma = value.size();
+        std::string item = trim(value.substr(start, comma - start));
+        if (!item.empty())
+            items.push_back(item);
+        start = comma + 1;
+    }
+    if (items.empty() && !allow_empty)
+        return false;
+    out = std::move(items);
+    return true;
+}
+
+bool parse_double(const std::string &value, double &out)
+{
+    try
+    {
+        out = std::stod(value);
+        return out >= 0;
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+}
+
+bool parse_bool(const std::string &value, bool &out)
+{
+    if (value == "true" || value == "yes" || value == "1")
+        out = true;
+    else if (value == "false" || value == "no" || value == "0")
+        out = false;
+    else
+        return false;
+    return true;
+}
+}
+
+SpotlightConfig load_config(const std::string &path)
+{
+    SpotlightConfig config;
+    std::ifstream in(path);
+    if (!in)
+        return config;
+
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line))
+    {
+        line_no++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos)
+            line.erase(hash);
+        line = trim(line);
+        if (line.empty())
+            continue;
+
+        size_t eq = line.find('=');
+        if (eq == std::string::npos)
+        {
+            std::cerr << path << ":" << line_no << ": expected key = value\n";
+            continue;
+        }
+        std::string key = trim(line.substr(0, eq));
+        std::string value = trim(line.substr(eq + 1));
+
+        bool ok = true;
+        if (key == "roots")
+            ok = parse_list(value, config.roots);
+        else if (key == "index_dir")
+            config.index_dir = value;
+        else if (key == "ignore")
+            ok = parse_list(value, config.ignore, true);
+        else if (key == "ignore_files")
+            ok = parse_list(value, config.ignore_files, true);
+        else if (key == "one_filesystem")
+            ok = parse_bool(value, config.one_filesystem);
+        else if (key == "trie_memory_budget_mb")
+            ok = parse_size(value, config.trie_memory_budget_mb, 20);
+        else if (key == "scan_min_interval_s")
+            ok = parse_size(value, config.scan_min_interval_s);
+        else if (key == "scan_max_interval_s")
+            ok = parse_size(value, config.scan_max_interval_s);
+        else if (key == "scan_initial_interval_s")
+            ok = parse_size(value, config.scan_initial_interval_s);
+        else if (key == "io_pressure_limit")
+            ok = parse_double(value, config.io_pressure_limit);
+        else if (key == "cpu_pressure_limit")
+            ok = parse_double(value, config.cpu_pressure_limit);
+        else if (key == "load_limit")
+            ok = parse_double(value, config.load_limit);
+        else if (key == "idle_io_priority")
+            ok = parse_bool(value, config.idle_io_priority);
+        else if (key == "content_indexing")
+            ok = parse_bool(value, config.content_indexing);
+        else if (key == "content_workers")
+            ok = parse_size(value, config.content_workers);
+        else if (key == "content_max_file_kb")
+            ok = parse_size(value, config.content_max_file_kb, 10);
+        else if (key == "content_max_mb_per_s")
+            ok = parse_size(value, config.content_max_mb_per_s, 20);
+        else if (key == "content_max_rss_mb")
+            ok = parse_size(value, config.content_max_rss_mb, 20);
+        else
+            std::cerr << path << ":" << line_no << ": unknown setting '" << key << "'\n";
+
+        if (!ok)
+            std::cerr << path << ":" << line_no << ": invalid value for '" << key << "'\n";
+    }
+    return config;
+}
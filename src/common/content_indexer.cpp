@@ -0,0 +1,241 @@
+#include "content_indexer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace
+{
+constexpr size_t READ_BLOCK = 64 * 1024;
+constexpr size_t SNIFF_BYTES = 4096;
+constexpr size_t MAX_CHUNK = 256;
+constexpr size_t MIN_WORD = 2;
+constexpr size_t MAX_WORD = 48;
+
+// Orphaned FTS documents are dropped by re-reading everything once they
+// outnumber the live ones.
+constexpr int64_t MIN_STALE_FOR_RESET = 10000;
+
+// NULs or a run of control characters in the first block mean binary.
+// Bytes >= 0x80 count as text so UTF-8 passes.
+bool looks_binary(const char *data, size_t n)
+{
+    size_t control = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        unsigned char c = static_cast<unsigned char>(data[i]);
+        if (c == 0)
+            return true;
+        if (c < 0x20 && c != '\t' && c != '\n' && c != '\r' && c != '\f' && c != '\v' && c != 0x1b)
+            control++;
+    }
+    return control * 10 > n;
+}
+
+bool is_word_byte(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+size_t resident_bytes()
+{
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    if (!(statm >> pages >> resident))
+        return 0;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+}
+
+ContentIndexer::ContentIndexer(SQLiteWrapper &db, const SpotlightConfig &config)
+    : db(db),
+      workers(std::max<size_t>(1, config.content_workers)),
+      max_file_bytes(std::max<size_t>(1, config.content_max_file_kb) << 10),
+      max_bytes_per_s(static_cast<uint64_t>(config.content_max_mb_per_s) << 20),
+      max_rss_bytes(config.content_max_rss_mb << 20)
+{
+}
+
+void ContentIndexer::set_chunk_hook(std::function<void()> hook)
+{
+    chunk_hook = std::move(hook);
+}
+
+// Every file in a chunk can hold up to max_file_bytes of text, twice over
+// while it is copied into the transaction, so the chunk shrinks as the
+// process approaches the RSS limit and drops to one file past it.
+size_t ContentIndexer::chunk_size() const
+{
+    if (max_rss_bytes == 0)
+        return MAX_CHUNK;
+
+    size_t rss = resident_bytes();
+    if (rss >= max_rss_bytes)
+        return 1;
+    size_t headroom = max_rss_bytes - rss;
+    return std::clamp<size_t>(headroom / (2 * max_file_bytes), 1, MAX_CHUNK);
+}
+
+void ContentIndexer::throttle(size_t bytes)
+{
+    if (max_bytes_per_s == 0)
+        return;
+
+    std::chrono::duration<double> wait(0);
+    {
+        std::lock_guard<std::mutex> lock(rate_mutex);
+        window_bytes += bytes;
+        std::chrono::duration<double> allowed(static_cast<double>(window_bytes) / max_bytes_per_s);
+        wait = allowed - (clock::now() - window_start);
+    }
+    if (wait.count() > 0)
+        std::this_thread::sleep_for(wait);
+}
+
+size_t ContentIndexer::extract(const SQLiteWrapper::ContentCandidate &file, SQLiteWrapper::ContentDocument &doc,
+                               std::vector<char> &buffer)
+{
+    doc.fileid = file.fileid;
+    doc.mtime = file.mtime;
+    doc.is_text = false;
+
+    // O_NONBLOCK so a FIFO that was indexed by name can't hang the worker.
+    int fd = open(file.absolute_path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK | O_NOCTTY);
+    if (fd < 0)
+        return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return 0;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    size_t limit = std::min<uint64_t>(max_file_bytes, static_cast<uint64_t>(st.st_size));
+    size_t total = 0;
+    std::string word;
+    bool first_block = true;
+
+    while (total < limit)
+    {
+        size_t want = first_block ? std::min(SNIFF_BYTES, limit) : std::min(buffer.size(), limit - total);
+        ssize_t n = read(fd, buffer.data(), want);
+        if (n <= 0)
+            break;
+        total += static_cast<size_t>(n);
+        throttle(static_cast<size_t>(n));
+
+        if (first_block)
+        {
+            first_block = false;
+            if (looks_binary(buffer.data(), static_cast<size_t>(n)))
+                break;
+            doc.is_text = true;
+            doc.body.reserve(std::min(limit, READ_BLOCK));
+        }
+
+        for (ssize_t i = 0; i < n; i++)
+        {
+            unsigned char c = static_cast<unsigned char>(buffer[i]);
+            if (is_word_byte(c))
+            {
+                if (word.size() <= MAX_WORD)
+                    word.push_back(c >= 'A' && c <= 'Z' ? static_cast<char>(c + 32) : static_cast<char>(c));
+                continue;
+            }
+            if (word.size() >= MIN_WORD && word.size() <= MAX_WORD)
+            {
+                doc.body += word;
+                doc.body.push_back(' ');
+            }
+            word.clear();
+        }
+    }
+    if (doc.is_text && word.size() >= MIN_WORD && word.size() <= MAX_WORD)
+        doc.body += word;
+
+    // The text is in the index now; don't let it push other files out of
+    // the page cache.
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    return total;
+}
+
+ContentStats ContentIndexer::run()
+{
+    ContentStats stats;
+
+    int64_t live = 0, stale = 0;
+    db.count_content_documents(live, stale);
+    if (stale >= MIN_STALE_FOR_RESET && stale > live)
+    {
+        db.reset_content_index();
+        stats.reset = true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(rate_mutex);
+        window_start = clock::now();
+        window_bytes = 0;
+    }
+
+    std::atomic<uint64_t> bytes_read{0};
+    std::atomic<uint64_t> text_files{0};
+    int64_t after = 0;
+
+    while (true)
+    {
+        if (chunk_hook)
+            chunk_hook();
+
+        std::vector<SQLiteWrapper::ContentCandidate> files = db.content_candidates(after, chunk_size());
+        if (files.empty())
+            break;
+        after = files.back().fileid;
+
+        std::vector<SQLiteWrapper::ContentDocument> docs(files.size());
+        std::atomic<size_t> next{0};
+        auto work = [&]()
+        {
+            std::vector<char> buffer(READ_BLOCK);
+            for (size_t i = next++; i < files.size(); i = next++)
+            {
+                bytes_read += extract(files[i], docs[i], buffer);
+                if (docs[i].is_text)
+                    text_files++;
+            }
+        };
+
+        size_t pool_size = std::min(workers, files.size());
+        std::vector<std::thread> pool;
+        for (size_t i = 1; i < pool_size; i++)
+            pool.emplace_back(work);
+        work();
+        for (auto &t : pool)
+            t.join();
+
+        db.batch_insert_content(docs);
+        stats.files_read += files.size();
+
+#ifdef __GLIBC__
+        // Worker arenas keep freed text around; hand it back so RSS tracks
+        // what is actually in use.
+        malloc_trim(0);
+#endif
+    }
+
+    stats.bytes_read = bytes_read;
+    stats.text_files = text_files;
+    stats.binary_files = stats.files_read - stats.text_files;
+    return stats;
+}
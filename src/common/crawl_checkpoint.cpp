@@ -0,0 +1,62 @@
+#include "crawl_checkpoint.h"
+
+#include <cstdio>
+#include <fstream>
+
+namespace
+{
+const std::string CHECKPOINT_MAGIC = "spotlight-checkpoint";
+constexpr int CHECKPOINT_VERSION = 1;
+}
+
+// A short text header followed by the pending paths, each terminated by a
+// NUL since a path may contain anything else.
+bool save_checkpoint(const std::string &path, const CrawlCheckpoint &checkpoint)
+{
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+
+        out << CHECKPOINT_MAGIC << ' ' << CHECKPOINT_VERSION << '\n'
+            << checkpoint.generation << ' ' << checkpoint.batches << ' ' << checkpoint.pending.size() << '\n';
+        out.write(checkpoint.root.c_str(), checkpoint.root.size() + 1);
+        for (const auto &dir : checkpoint.pending)
+            out.write(dir.c_str(), dir.size() + 1);
+
+        out.flush();
+        if (!out)
+            return false;
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool load_checkpoint(const std::string &path, CrawlCheckpoint &checkpoint)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+
+    std::string magic;
+    int version = 0;
+    size_t count = 0;
+    in >> magic >> version >> checkpoint.generation >> checkpoint.batches >> count;
+    if (!in || magic != CHECKPOINT_MAGIC || version != CHECKPOINT_VERSION)
+        return false;
+    in.ignore(1);
+
+    if (!std::getline(in, checkpoint.root, '\0'))
+        return false;
+
+    checkpoint.pending.clear();
+    std::string dir;
+    while (checkpoint.pending.size() < count && std::getline(in, dir, '\0'))
+        checkpoint.pending.push_back(dir);
+    return checkpoint.pending.size() == count;
+}
+
+void remove_checkpoint(const std::string &path)
+{
+    std::remove(path.c_str());
+}
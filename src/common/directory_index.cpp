@@ -0,0 +1,301 @@
+#include "directory_index.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+static const char DIR_INDEX_MAGIC[8] = {'S', 'P', 'D', 'I', 'R', '\0', '\0', '\0'};
+static const uint32_t DIR_INDEX_VERSION = 2;
+static const int MAX_ALIAS_HOPS = 8;
+
+// "/a/b" -> "/a", "/a" -> "/", and "/" or a relative name -> "".
+std::string DirectoryIndex::parent_of(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    if (slash == std::string::npos || path == "/") {
+        return "";
+    }
+    return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+// Ancestors are interned first, so every directory's parent is already
+// present and the directories form one tree per filesystem root.
+uint32_t DirectoryIndex::intern(const std::string& directory) {
+    auto it = ids.find(directory);
+    if (it != ids.end()) {
+        return it->second;
+    }
+
+    std::string parent = parent_of(directory);
+    uint32_t parent_id = parent.empty() ? NONE : intern(parent);
+    uint32_t id = static_cast<uint32_t>(paths.size());
+    ids.emplace(directory, id);
+    paths.push_back(directory);
+    parents.push_back(parent_id);
+    intervals.emplace_back();
+    return id;
+}
+
+void DirectoryIndex::add(const std::string& absolute_path, int64_t fileid) {
+    if (fileid < 0 || fileid >= NONE) {
+        return;
+    }
+    size_t i = static_cast<size_t>(fileid);
+    if (i < file_dirs.size() && file_dirs[i] != NONE) {
+        return;
+    }
+    std::string directory = parent_of(absolute_path);
+    if (directory.empty()) {
+        return;
+    }
+
+    if (i >= file_dirs.size()) {
+        file_dirs.resize(i + 1, NONE);
+    }
+    file_dirs[i] = intern(directory);
+    numbered = false;
+}
+
+void DirectoryIndex::remove(int64_t fileid) {
+    if (fileid < 0 || static_cast<uint64_t>(fileid) >= file_dirs.size() || file_dirs[fileid] == NONE) {
+        return;
+    }
+    file_dirs[fileid] = NONE;
+    numbered = false;
+}
+
+void DirectoryIndex::add_alias(const std::string& alias, const std::string& target) {
+    aliases[alias] = target;
+}
+
+void DirectoryIndex::remove_aliases(const std::string& directory) {
+    for (auto it = aliases.begin(); it != aliases.end();) {
+        const std::string& alias = it->first;
+        bool below = directory == "/" || alias == directory ||
+                     (alias.compare(0, directory.size(), directory) == 0 && alias[directory.size()] == '/');
+        it = below ? aliases.erase(it) : std::next(it);
+    }
+}
+
+void DirectoryIndex::clear() {
+    ids.clear();
+    paths.clear();
+    parents.clear();
+    intervals.clear();
+    file_dirs.clear();
+    file_numbers.clear();
+    aliases.clear();
+    numbered = true;
+}
+
+// An iterative pre-order walk: a directory takes the next number on the
+// way down, and its interval closes at the last number handed out below
+// it. Directories left without files keep their numbers; they cost a slot
+// each and vanish on the next rebuild.
+void DirectoryIndex::number() {
+    if (numbered) {
+        return;
+    }
+
+    size_t n = paths.size();
+    std::vector<uint32_t> child_start(n + 1, 0);
+    for (uint32_t parent : parents) {
+        if (parent != NONE) {
+            child_start[parent + 1]++;
+        }
+    }
+    for (size_t d = 0; d < n; d++) {
+        child_start[d + 1] += child_start[d];
+    }
+    std::vector<uint32_t> children(child_start[n]);
+    std::vector<uint32_t> filled(child_start.begin(), child_start.end() - 1);
+    for (uint32_t d = 0; d < n; d++) {
+        if (parents[d] != NONE) {
+            children[filled[parents[d]]++] = d;
+        }
+    }
+
+    uint32_t next = 0;
+    std::vector<std::pair<uint32_t, uint32_t>> stack;
+    for (uint32_t root = 0; root < n; root++) {
+        if (parents[root] != NONE) {
+            continue;
+        }
+        intervals[root].first = next++;
+        stack.emplace_back(root, child_start[root]);
+        while (!stack.empty()) {
+            auto& [dir, child] = stack.back();
+            if (child == child_start[dir + 1]) {
+                intervals[dir].last = next - 1;
+                stack.pop_back();
+                continue;
+            }
+            uint32_t sub = children[child++];
+            intervals[sub].first = next++;
+            stack.emplace_back(sub, child_start[sub]);
+        }
+    }
+
+    file_numbers.assign(file_dirs.size(), NONE);
+    for (size_t f = 0; f < file_dirs.size(); f++) {
+        if (file_dirs[f] != NONE) {
+            file_numbers[f] = intervals[file_dirs[f]].first;
+        }
+    }
+    numbered = true;
+}
+
+bool DirectoryIndex::empty() const {
+    return paths.empty();
+}
+
+size_t DirectoryIndex::directory_count() const {
+    return paths.size();
+}
+
+const std::vector<std::string>& DirectoryIndex::directories() const {
+    return paths;
+}
+
+bool DirectoryIndex::find(const std::string& directory, Interval& out) const {
+    std::string key = directory;
+    while (key.size() > 1 && key.back() == '/') {
+        key.pop_back();
+    }
+
+    // The nearest aliased ancestor is swapped for its target; a target can
+    // hold aliases of its own, so this repeats a bounded number of times.
+    for (int hop = 0; hop < MAX_ALIAS_HOPS && !aliases.empty(); hop++) {
+        std::string ancestor = key;
+        auto alias = aliases.end();
+        while (!ancestor.empty() && (alias = aliases.find(ancestor)) == aliases.end()) {
+            ancestor = parent_of(ancestor);
+        }
+        if (alias == aliases.end()) {
+            break;
+        }
+        std::string rest = key.substr(ancestor.size());
+        key = alias->second == "/" && !rest.empty() ? rest : alias->second + rest;
+    }
+
+    auto it = ids.find(key);
+    if (it == ids.end() || !numbered) {
+        return false;
+    }
+    out = intervals[it->second];
+    return true;
+}
+
+void DirectoryIndex::save(const std::string& filename) {
+    number();
+
+    std::ofstream out(filename, std::ios::binary);
+    if (!out) {
+        std::cerr << "Error opening file for writing: " << filename << std::endl;
+        return;
+    }
+
+    out.write(DIR_INDEX_MAGIC, sizeof(DIR_INDEX_MAGIC));
+    out.write(reinterpret_cast<const char*>(&DIR_INDEX_VERSION), sizeof(DIR_INDEX_VERSION));
+    uint64_t count = paths.size();
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (size_t d = 0; d < paths.size(); d++) {
+        uint32_t len = static_cast<uint32_t>(paths[d].size());
+        out.write(reinterpret_cast<const char*>(&len), sizeof(len));
+        out.write(paths[d].data(), len);
+        out.write(reinterpret_cast<const char*>(&parents[d]), sizeof(parents[d]));
+        out.write(reinterpret_cast<const char*>(&intervals[d]), sizeof(intervals[d]));
+    }
+    uint64_t files = file_dirs.size();
+    out.write(reinterpret_cast<const char*>(&files), sizeof(files));
+    out.write(reinterpret_cast<const char*>(file_dirs.data()), files * sizeof(uint32_t));
+
+    uint64_t alias_count = aliases.size();
+    out.write(reinterpret_cast<const char*>(&alias_count), sizeof(alias_count));
+    for (const auto& [alias, target] : aliases) {
+        for (const std::string* s : {&alias, &target}) {
+            uint32_t len = static_cast<uint32_t>(s->size());
+            out.write(reinterpret_cast<const char*>(&len), sizeof(len));
+            out.write(s->data(), len);
+        }
+    }
+}
+
+bool DirectoryIndex::load(const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) {
+        std::cerr << "Error opening file for reading: " << filename << std::endl;
+        return false;
+    }
+
+    char magic[sizeof(DIR_INDEX_MAGIC)];
+    uint32_t version = 0;
+    uint64_t count = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (!in || std::memcmp(magic, DIR_INDEX_MAGIC, sizeof(magic)) != 0 || version != DIR_INDEX_VERSION ||
+        count >= NONE) {
+        std::cerr << "Unsupported directory index format in " << filename << std::endl;
+        return false;
+    }
+
+    DirectoryIndex loaded;
+    for (uint64_t d = 0; d < count && in; d++) {
+        uint32_t len = 0;
+        in.read(reinterpret_cast<char*>(&len), sizeof(len));
+        std::string path(len, '\0');
+        in.read(&path[0], len);
+        uint32_t parent = NONE;
+        Interval interval;
+        in.read(reinterpret_cast<char*>(&parent), sizeof(parent));
+        in.read(reinterpret_cast<char*>(&interval), sizeof(interval));
+        if (parent != NONE && parent >= d) {
+            in.setstate(std::ios::failbit);
+        }
+        loaded.ids.emplace(path, static_cast<uint32_t>(d));
+        loaded.paths.push_back(std::move(path));
+        loaded.parents.push_back(parent);
+        loaded.intervals.push_back(interval);
+    }
+    uint64_t files = 0;
+    in.read(reinterpret_cast<char*>(&files), sizeof(files));
+    if (in && files < NONE) {
+        loaded.file_dirs.resize(files);
+        in.read(reinterpret_cast<char*>(loaded.file_dirs.data()), files * sizeof(uint32_t));
+    }
+    uint64_t alias_count = 0;
+    in.read(reinterpret_cast<char*>(&alias_count), sizeof(alias_count));
+    for (uint64_t a = 0; a < alias_count && in; a++) {
+        std::string pair[2];
+        for (std::string& s : pair) {
+            uint32_t len = 0;
+            in.read(reinterpret_cast<char*>(&len), sizeof(len));
+            if (!in) {
+                break;
+            }
+            s.resize(len);
+            in.read(&s[0], len);
+        }
+        loaded.aliases[pair[0]] = pair[1];
+    }
+    if (!in || files >= NONE) {
+        std::cerr << "Truncated directory index " << filename << std::endl;
+        return false;
+    }
+
+    loaded.file_numbers.assign(files, NONE);
+    for (size_t f = 0; f < files; f++) {
+        uint32_t dir = loaded.file_dirs[f];
+        if (dir != NONE && dir >= count) {
+            std::cerr << "Corrupt directory index " << filename << std::endl;
+            return false;
+        }
+        if (dir != NONE) {
+            loaded.file_numbers[f] = loaded.intervals[dir].first;
+        }
+    }
+
+    *this = std::move(loaded);
+    return true;
+}
@@ -0,0 +1,116 @@
+#include "extension_index.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+static const char EXT_INDEX_MAGIC[8] = {'S', 'P', 'E', 'X', 'T', '\0', '\0', '\0'};
+static const uint32_t EXT_INDEX_VERSION = 2;
+
+std::string ExtensionIndex::normalize(const std::string& ext) {
+    std::string key = ext;
+    std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return std::tolower(c); });
+    return key;
+}
+
+void ExtensionIndex::add(const std::string& ext, int64_t fileid) {
+    if (fileid < 0 || fileid > UINT32_MAX) {
+        return;
+    }
+    bitmaps[normalize(ext)].add(static_cast<uint32_t>(fileid));
+}
+
+void ExtensionIndex::remove(const std::string& ext, int64_t fileid) {
+    if (fileid < 0 || fileid > UINT32_MAX) {
+        return;
+    }
+    auto it = bitmaps.find(normalize(ext));
+    if (it == bitmaps.end()) {
+        return;
+    }
+    it->second.remove(static_cast<uint32_t>(fileid));
+    if (it->second.empty()) {
+        bitmaps.erase(it);
+    }
+}
+
+void ExtensionIndex::clear() {
+    bitmaps.clear();
+}
+
+const RoaringBitmap* ExtensionIndex::find(const std::string& ext) const {
+    auto it = bitmaps.find(normalize(ext));
+    return it == bitmaps.end() ? nullptr : &it->second;
+}
+
+RoaringBitmap ExtensionIndex::match_any(const std::vector<std::string>& extensions) const {
+    RoaringBitmap result;
+    for (const auto& ext : extensions) {
+        if (const RoaringBitmap* bitmap = find(ext)) {
+            result = result | *bitmap;
+        }
+    }
+    return result;
+}
+
+uint64_t ExtensionIndex::count(const std::string& ext) const {
+    const RoaringBitmap* bitmap = find(ext);
+    return bitmap ? bitmap->cardinality() : 0;
+}
+
+bool ExtensionIndex::empty() const {
+    return bitmaps.empty();
+}
+
+void ExtensionIndex::save(const std::string& filename) const {
+    std::ofstream out(filename, std::ios::binary);
+    if (!out) {
+        std::cerr << "Error opening file for writing: " << filename << std::endl;
+        return;
+    }
+
+    out.write(EXT_INDEX_MAGIC, sizeof(EXT_INDEX_MAGIC));
+    out.write(reinterpret_cast<const char*>(&EXT_INDEX_VERSION), sizeof(EXT_INDEX_VERSION));
+    uint64_t count = bitmaps.size();
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (const auto& [ext, bitmap] : bitmaps) {
+        uint32_t len = static_cast<uint32_t>(ext.size());
+        out.write(reinterpret_cast<const char*>(&len), sizeof(len));
+        out.write(ext.data(), len);
+        bitmap.write(out);
+    }
+}
+
+bool ExtensionIndex::load(const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) {
+        std::cerr << "Error opening file for reading: " << filename << std::endl;
+        return false;
+    }
+
+    char magic[sizeof(EXT_INDEX_MAGIC)];
+    uint32_t version = 0;
+    uint64_t count = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (!in || std::memcmp(magic, EXT_INDEX_MAGIC, sizeof(magic)) != 0 || version != EXT_INDEX_VERSION) {
+        std::cerr << "Unsupported extension index format in " << filename << std::endl;
+        return false;
+    }
+
+    std::unordered_map<std::string, RoaringBitmap> loaded;
+    for (uint64_t i = 0; i < count; i++) {
+        uint32_t len = 0;
+        in.read(reinterpret_cast<char*>(&len), sizeof(len));
+        std::string ext(len, '\0');
+        in.read(&ext[0], len);
+        if (!in || !loaded[ext].read(in)) {
+            std::cerr << "Truncated extension index " << filename << std::endl;
+            return false;
+        }
+    }
+
+    bitmaps = std::move(loaded);
+    return true;
+}
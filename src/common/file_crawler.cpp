@@ -1,5 +1,9 @@
 #include "file_crawler.h"
 
+#include <algorithm>
+
+#include <sys/stat.h>
+
 #include "ignored_folders.h"
 #include "util.h"
 
@@ -58,44 +62,431 @@ string slice_after_last(const string &str, char delimiter)
     return str.substr(pos + 1);
 }
 
+FileSystemCrawler::FileSystemCrawler(const string &path, const string &db_path)
+    : root_path(path), db_wrapper(db_path)
+{
+    known_paths.load(db_wrapper);
+    set_ignore_rules(default_ignore_rules, default_ignore_files);
+}
+
+// What follows the last dot of a file name. Names without one, and
+// dotfiles like .bashrc whose only dot leads, have no extension.
+string extension_of(const string &filename)
+{
+    size_t dot = filename.find_last_of('.');
+    if (dot == string::npos || dot == 0)
+    {
+        return "";
+    }
+    return filename.substr(dot + 1);
+}
+
+static string without_trailing_slash(string path)
+{
+    while (path.size() > 1 && path.back() == '/')
+    {
+        path.pop_back();
+    }
+    return path;
+}
+
+static bool is_under(const string &path, const string &dir)
+{
+    return dir == "/" || path == dir || (path.compare(0, dir.size(), dir) == 0 && path[dir.size()] == '/');
+}
+
+// Directories under the root are claimed afresh as the walk reaches them,
+// and the aliases found there last time are found again.
 void FileSystemCrawler::crawl(const string &root)
 {
-    std::stack<fs::path> dirs;
-    std::vector<FileRecord> file_batch;
-    const size_t BATCH_SIZE = 1000;
+    stats = CrawlStats();
+    generation = std::max(generation, db_wrapper.max_generation()) + 1;
+    batches_committed = 0;
+    crawl_root = root;
+    queued_dirs = {root};
+    deferred_links.clear();
+
+    string base = without_trailing_slash(root);
+    for (auto it = visited_dirs.begin(); it != visited_dirs.end();)
+    {
+        it = is_under(it->second, base) ? visited_dirs.erase(it) : std::next(it);
+    }
+    directory_index.remove_aliases(base);
+    run_queue();
+}
+
+bool FileSystemCrawler::resume_crawl(bool from_database)
+{
+    CrawlCheckpoint checkpoint;
+    if (checkpoint_path.empty() || !load_checkpoint(checkpoint_path, checkpoint))
+    {
+        return false;
+    }
+
+    auto restore = [&](const SQLiteWrapper::FileResult &row)
+    {
+        trie_searcher.insert(row.filename, row.absolute_path, row.extension, row.fileid);
+        extension_index.add(row.extension, row.fileid);
+        token_index.add(tokenize(row.absolute_path), row.fileid);
+        directory_index.add(row.absolute_path, row.fileid);
+    };
+    if (from_database)
+        db_wrapper.scan_files(restore);
+    else
+        db_wrapper.scan_generation(checkpoint.generation, restore);
+
+    // The checkpoint doesn't record which directories were walked, but the
+    // directory index holds them, along with the last crawl's. Claiming
+    // them again means a symlink or bind mount still pending is recorded
+    // as an alias instead of walking a tree a second time. A pending
+    // directory claimed here under its own path is still walked; lstat
+    // keeps a symlink indexed as a directory from claiming its target.
+    string base = without_trailing_slash(checkpoint.root);
+    struct stat st;
+    for (const auto &dir : directory_index.directories())
+    {
+        if (is_under(dir, base) && lstat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            visited_dirs.try_emplace(DirectoryKey{static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino)},
+                                     dir);
+        }
+    }
+
+    stats = CrawlStats();
+    generation = checkpoint.generation;
+    batches_committed = checkpoint.batches;
+    crawl_root = checkpoint.root;
+    queued_dirs = std::move(checkpoint.pending);
+    deferred_links.clear();
+    run_queue();
+    return true;
+}
+
+// queued_dirs is a stack: the crawl root, or a checkpoint's frontier with
+// the next directory to visit at the back. Symlinked directories and mount
+// roots found on the way wait in deferred_links until the stack is empty.
+void FileSystemCrawler::run_queue()
+{
+    struct stat st;
+    root_dev = stat(root_path.c_str(), &st) == 0 ? st.st_dev : 0;
+    last_checkpoint = std::chrono::steady_clock::now();
+    while (!queued_dirs.empty() || !deferred_links.empty())
+    {
+        if (queued_dirs.empty())
+        {
+            queued_dirs.assign(deferred_links.rbegin(), deferred_links.rend());
+            deferred_links.clear();
+        }
+        string dir = std::move(queued_dirs.back());
+        queued_dirs.pop_back();
+        walk(dir);
+    }
+    drain();
+    sweep();
+    if (!checkpoint_path.empty())
+    {
+        remove_checkpoint(checkpoint_path);
+    }
+}
+
+// Every file still under the crawl root has just been stamped with this
+// generation, so anything older there is gone from disk. Runs before the
+// checkpoint is dropped: a crawl killed mid-sweep resumes with nothing
+// left to walk and sweeps again.
+void FileSystemCrawler::sweep()
+{
+    stats.removed = db_wrapper.sweep_generation(generation, crawl_root, [&](const SQLiteWrapper::FileResult &row)
+    {
+        trie_searcher.remove_file(row.filename, row.absolute_path);
+        extension_index.remove(row.extension, row.fileid);
+        token_index.remove(row.fileid);
+        directory_index.remove(row.fileid);
+        known_paths.erase(row.absolute_path);
+    });
+}
+
+void FileSystemCrawler::walk(const string &dir)
+{
+    IgnoreChain ignore = ignore_chain_for(dir);
+    if (backend == CrawlBackend::Getdents)
+    {
+        crawl_getdents(dir, std::move(ignore));
+    }
+    else
+    {
+        crawl_iterator(dir, std::move(ignore));
+    }
+}
+
+// A walk that starts below the root (a unit rescan, or a resumed crawl's
+// frontier) still owes its directory the ignore files of every ancestor
+// up to the root; the directory's own are read when it is listed.
+IgnoreChain FileSystemCrawler::ignore_chain_for(const string &dir) const
+{
+    IgnoreChain chain = ignore_root;
+    string base = root_path;
+    while (!base.empty() && base.back() == '/')
+    {
+        base.pop_back();
+    }
+    if (!(base.empty() || dir == base || dir.compare(0, base.size() + 1, base + "/") == 0))
+    {
+        return chain;
+    }
+
+    string ancestor = base;
+    while (ancestor.size() < dir.size())
+    {
+        chain = enter_directory(chain, ancestor, ignore_files);
+        size_t next = dir.find('/', ancestor.size() + 1);
+        if (next == string::npos)
+        {
+            break;
+        }
+        ancestor = dir.substr(0, next);
+    }
+    return chain;
+}
+
+// A directory is walked under the first path that reaches it; any other
+// path is recorded as its alias. The first path is checked before the new
+// one is turned away, since it may be gone and its inode number reused.
+bool FileSystemCrawler::claim_directory(const string &path, uint64_t dev, uint64_t ino)
+{
+    if (one_filesystem && dev != root_dev)
+    {
+        stats.other_filesystems++;
+        return false;
+    }
+
+    string dir = without_trailing_slash(path);
+    auto [it, inserted] = visited_dirs.try_emplace(DirectoryKey{dev, ino}, dir);
+    if (inserted || it->second == dir)
+    {
+        return true;
+    }
+    struct stat st;
+    if (stat(it->second.c_str(), &st) != 0 || st.st_dev != dev || st.st_ino != ino)
+    {
+        it->second = dir;
+        return true;
+    }
+    directory_index.add_alias(dir, it->second);
+    stats.aliases++;
+    return false;
+}
+
+bool FileSystemCrawler::is_ignore_file(const char *name) const
+{
+    for (const auto &file : ignore_files)
+    {
+        if (file == name)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FileSystemCrawler::drain()
+{
+    while (!file_batch.empty() || !stat_pending.empty())
+    {
+        flush_batch();
+    }
+}
+
+// Called between directories, when every file found so far is in a batch.
+// Draining the batches first means the saved frontier is exactly what is
+// left to crawl.
+void FileSystemCrawler::checkpoint_if_due(const std::function<void(std::vector<string> &)> &frontier)
+{
+    if (checkpoint_path.empty() || std::chrono::steady_clock::now() - last_checkpoint < CHECKPOINT_INTERVAL)
+    {
+        return;
+    }
+
+    drain();
+    CrawlCheckpoint checkpoint;
+    checkpoint.generation = generation;
+    checkpoint.batches = batches_committed;
+    checkpoint.root = crawl_root;
+    checkpoint.pending.assign(deferred_links.rbegin(), deferred_links.rend());
+    checkpoint.pending.insert(checkpoint.pending.end(), queued_dirs.begin(), queued_dirs.end());
+    frontier(checkpoint.pending);
+    if (!save_checkpoint(checkpoint_path, checkpoint))
+    {
+        std::cerr << "Error writing crawl checkpoint " << checkpoint_path << '\n';
+    }
+    last_checkpoint = std::chrono::steady_clock::now();
+}
 
-    dirs.push(root);
+void FileSystemCrawler::set_backend(CrawlBackend b)
+{
+    backend = b;
+}
+
+void FileSystemCrawler::set_collect_metadata(bool enabled)
+{
+    collect_metadata = enabled;
+}
+
+void FileSystemCrawler::set_one_filesystem(bool enabled)
+{
+    one_filesystem = enabled;
+}
+
+void FileSystemCrawler::set_batch_hook(std::function<void()> hook)
+{
+    batch_hook = std::move(hook);
+}
+
+void FileSystemCrawler::set_checkpoint_path(const string &path)
+{
+    checkpoint_path = path;
+}
+
+void FileSystemCrawler::set_ignore_rules(const std::vector<string> &patterns,
+                                         const std::vector<string> &ignore_file_names)
+{
+    auto layer = std::make_shared<IgnoreLayer>();
+    for (const auto &pattern : patterns)
+    {
+        layer->rules.add(pattern);
+    }
+    layer->base = root_path;
+    if (layer->base.empty() || layer->base.back() != '/')
+    {
+        layer->base.push_back('/');
+    }
+    ignore_root = std::move(layer);
+    ignore_files = ignore_file_names;
+}
+
+int64_t FileSystemCrawler::get_generation() const
+{
+    return generation;
+}
+
+const CrawlStats &FileSystemCrawler::last_crawl_stats() const
+{
+    return stats;
+}
+
+const string &FileSystemCrawler::get_root() const
+{
+    return root_path;
+}
+
+void FileSystemCrawler::add_file(FileRecord &&rec)
+{
+    rec.tokens = tokenize(rec.absolute_path);
+    file_batch.push_back(std::move(rec));
+    if (file_batch.size() >= BATCH_SIZE)
+    {
+        flush_batch();
+    }
+}
+
+// With metadata enabled the batch is handed to the statx ring and written
+// one flush later, so its stat calls run while the next batch is crawled.
+void FileSystemCrawler::flush_batch()
+{
+    if (batch_hook)
+    {
+        batch_hook();
+    }
+
+    stat_batcher.wait();
+    std::vector<FileRecord> ready;
+    std::swap(ready, stat_pending);
+    if (collect_metadata)
+    {
+        std::swap(stat_pending, file_batch);
+        if (!stat_pending.empty())
+        {
+            stat_batcher.submit(stat_pending);
+        }
+    }
+
+    if (!ready.empty())
+    {
+        process_files(ready);
+    }
+    if (!file_batch.empty())
+    {
+        process_files(file_batch);
+        file_batch.clear();
+    }
+}
+
+// Each queued directory carries the ignore rules in force where it was
+// found. A directory's entries are all read before any is kept, so its own
+// ignore files apply to entries listed ahead of them.
+void FileSystemCrawler::crawl_iterator(const string &root, IgnoreChain ignore)
+{
+    std::vector<std::pair<fs::path, IgnoreChain>> dirs;
+
+    dirs.emplace_back(root, std::move(ignore));
     while (!dirs.empty())
     {
-        fs::path current_dir = dirs.top();
-        dirs.pop();
+        checkpoint_if_due([&](std::vector<string> &pending)
+        {
+            for (const auto &dir : dirs)
+            {
+                pending.push_back(dir.first.string());
+            }
+        });
+
+        fs::path current_dir = std::move(dirs.back().first);
+        IgnoreChain rules = std::move(dirs.back().second);
+        dirs.pop_back();
+        struct stat st;
+        if (stat(current_dir.c_str(), &st) != 0 || !claim_directory(current_dir.string(), st.st_dev, st.st_ino))
+        {
+            continue;
+        }
+        stats.directories++;
+
+        std::vector<fs::directory_entry> entries;
+        bool has_ignore_file = false;
         for (const auto &entry : fs::directory_iterator(current_dir, fs::directory_options::skip_permission_denied))
+        {
+            entries.push_back(entry);
+            has_ignore_file = has_ignore_file || is_ignore_file(entry.path().filename().c_str());
+        }
+        if (has_ignore_file)
+        {
+            rules = enter_directory(rules, current_dir.string(), ignore_files);
+        }
+
+        for (const auto &entry : entries)
         {
             try
             {
-                if (entry.is_directory())
+                string file_path = entry.path().string();
+                string name = slice_after_last(file_path, '/');
+                bool is_dir = entry.is_directory();
+                if (is_ignored(rules, file_path, name.c_str(), is_dir))
+                {
+                    continue;
+                }
+
+                if (is_dir && entry.is_symlink())
                 {
-                    string folder_name = slice_after_last(entry.path().string(), '/');
-                    if (!is_ignorable(folder_name))
-                    {
-                        dirs.push(entry.path());
-                    };
+                    deferred_links.push_back(file_path);
+                }
+                else if (is_dir)
+                {
+                    dirs.emplace_back(entry.path(), rules);
                 }
                 else
                 {
-                    string file_path = entry.path().string();
                     FileRecord rec;
-                    rec.filename = slice_after_last(file_path, '/');
+                    rec.filename = name;
                     rec.absolute_path = file_path;
-                    rec.extension = slice_after_last(file_path, '.');
-                    rec.tokens = tokenize(file_path);
-                    trie_searcher.insert(rec.filename,rec.absolute_path, rec.extension);
-                    file_batch.push_back(std::move(rec));
-                    if (file_batch.size() >= BATCH_SIZE)
-                    {
-                        process_files(file_batch);
-                        file_batch.clear();
-                    }
+                    rec.extension = extension_of(name);
+                    add_file(std::move(rec));
                 }
             }
             catch (const fs::filesystem_error &e)
@@ -104,20 +495,13 @@ void FileSystemCrawler::crawl(const string &root)
             }
         }
     }
-
-    if (!file_batch.empty())
-    {
-        process_files(file_batch);
-    }
 }
 
+// Checks a directory directly under the root against the configured
+// rules; per-directory ignore files are applied by the walk itself.
 bool FileSystemCrawler::is_ignorable(const string &folder_name)
 {
-    if (ignored_folders_list.count(folder_name) || folder_name[0] == '.')
-    {
-        return true;
-    }
-    return false;
+    return is_ignored(ignore_root, ignore_root->base + folder_name, folder_name.c_str(), true);
 }
 
 void FileSystemCrawler::initializing_crawl()
@@ -128,15 +512,66 @@ void FileSystemCrawler::initializing_crawl()
     crawl(root_path);
 }
 
+static uint64_t mix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
 void FileSystemCrawler::process_files(std::vector<FileRecord> &files)
 {
-    db_wrapper.batch_insert_files(files);
+    for (const auto &file : files)
+    {
+        uint64_t h = std::hash<string>()(file.absolute_path);
+        stats.fingerprint += mix64(h ^ mix64(file.size ^ (static_cast<uint64_t>(file.mtime) << 1)));
+    }
+    stats.files += files.size();
+
+    for (auto &file : files)
+    {
+        file.fileid = known_paths.find(file.absolute_path);
+    }
+    db_wrapper.batch_insert_files(files, generation);
+    batches_committed++;
+    for (const auto &file : files)
+    {
+        if (file.fileid != -1)
+            known_paths.insert(file.absolute_path, file.fileid);
+        trie_searcher.insert(file.filename, file.absolute_path, file.extension, file.fileid);
+        extension_index.add(file.extension, file.fileid);
+        token_index.add(file.tokens, file.fileid);
+        directory_index.add(file.absolute_path, file.fileid);
+    }
 }
 
-std::vector<SQLiteWrapper::FileResult> FileSystemCrawler::index_search(std::string &prefix,short offset) {
-    return db_wrapper.search(prefix, 10, offset);
+std::vector<SQLiteWrapper::FileResult> FileSystemCrawler::index_search(std::string &prefix,
+                                                                       SQLiteWrapper::SearchCursor *cursor,
+                                                                       const std::function<bool(int64_t)> &accept) {
+    return db_wrapper.search(prefix, SEARCH_LIMIT, cursor, accept);
 }
 
 TrieSearch& FileSystemCrawler::get_trie() {
     return trie_searcher;
+}
+
+SQLiteWrapper& FileSystemCrawler::get_db() {
+    return db_wrapper;
+}
+
+ExtensionIndex& FileSystemCrawler::get_extension_index() {
+    return extension_index;
+}
+
+TokenIndex& FileSystemCrawler::get_token_index() {
+    return token_index;
+}
+
+DirectoryIndex& FileSystemCrawler::get_directory_index() {
+    return directory_index;
+}
+
+PathIndex& FileSystemCrawler::get_path_index() {
+    return known_paths;
 }
\ No newline at end of file
@@ -0,0 +1,268 @@
+//
+// Raw Linux crawl backend: walks the tree with openat() relative to the
+// parent directory fd and large getdents64() reads, classifying entries by
+// d_type so regular files never need a stat().
+//
+
+#include "file_crawler.h"
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+namespace
+{
+struct linux_dirent64
+{
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+constexpr size_t DIRENT_BUFFER_SIZE = 256 * 1024;
+
+// One open directory on the walk stack. Its entries are read completely
+// before any child is opened, so a single getdents buffer is enough and the
+// number of open fds is bounded by the tree depth. ignore starts as the
+// parent's rules and gains the directory's own ignore files once listed.
+struct DirFrame
+{
+    int fd;
+    size_t path_len;
+    std::vector<string> subdirs;
+    IgnoreChain ignore;
+};
+
+bool is_dot_entry(const char *name)
+{
+    return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+// d_type is DT_UNKNOWN on some filesystems, and symlinks are followed to
+// match fs::directory_entry::is_directory(); a symlinked directory is then
+// put off until the rest of the crawl is done.
+unsigned char resolve_type(int dir_fd, const char *name)
+{
+    struct stat st;
+    if (fstatat(dir_fd, name, &st, 0) != 0)
+    {
+        return DT_REG;
+    }
+    return S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+}
+
+// Where statx reports it, a directory that is the root of a mount is put
+// off like a symlink, so a bind mount becomes the alias and the directory
+// it shows is indexed under its own path.
+bool identify_directory(int fd, uint64_t &dev, uint64_t &ino, bool &mount_root)
+{
+    mount_root = false;
+#ifdef STATX_ATTR_MOUNT_ROOT
+    struct statx stx;
+    if (statx(fd, "", AT_EMPTY_PATH, STATX_INO, &stx) == 0)
+    {
+        dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+        ino = stx.stx_ino;
+        mount_root = (stx.stx_attributes_mask & stx.stx_attributes & STATX_ATTR_MOUNT_ROOT) != 0;
+        return true;
+    }
+#endif
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        return false;
+    }
+    dev = st.st_dev;
+    ino = st.st_ino;
+    return true;
+}
+}
+
+void FileSystemCrawler::crawl_getdents(const string &root, IgnoreChain ignore)
+{
+    int root_fd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0)
+    {
+        std::cerr << "Error accessing " << root << ": " << strerror(errno) << '\n';
+        return;
+    }
+    uint64_t dev = 0;
+    uint64_t ino = 0;
+    bool mount_root = false;
+    if (!identify_directory(root_fd, dev, ino, mount_root) || !claim_directory(root, dev, ino))
+    {
+        close(root_fd);
+        return;
+    }
+
+    std::vector<char> buffer(DIRENT_BUFFER_SIZE);
+    string path = root;
+    if (path.empty() || path.back() != '/')
+    {
+        path.push_back('/');
+    }
+
+    // A directory's names are gathered first, so that ignore files listed
+    // after some entries still apply to them; pruned directories are never
+    // opened.
+    struct Entry
+    {
+        size_t name_off;
+        unsigned char type;
+        bool link;
+    };
+    string names;
+    std::vector<Entry> entries;
+
+    auto read_directory = [&](DirFrame &frame)
+    {
+        stats.directories++;
+        names.clear();
+        entries.clear();
+        bool has_ignore_file = false;
+        while (true)
+        {
+            long n = syscall(SYS_getdents64, frame.fd, buffer.data(), buffer.size());
+            if (n <= 0)
+            {
+                if (n < 0)
+                {
+                    std::cerr << "Error reading " << path << ": " << strerror(errno) << '\n';
+                }
+                break;
+            }
+
+            for (long off = 0; off < n;)
+            {
+                auto *d = reinterpret_cast<linux_dirent64 *>(buffer.data() + off);
+                off += d->d_reclen;
+
+                const char *name = d->d_name;
+                if (is_dot_entry(name))
+                {
+                    continue;
+                }
+
+                unsigned char type = d->d_type;
+                bool link = type == DT_LNK;
+                if (type == DT_UNKNOWN || link)
+                {
+                    type = resolve_type(frame.fd, name);
+                }
+                if (type != DT_DIR && !has_ignore_file)
+                {
+                    has_ignore_file = is_ignore_file(name);
+                }
+
+                entries.push_back({names.size(), type, link});
+                names.append(name);
+                names.push_back('\0');
+            }
+        }
+
+        if (has_ignore_file)
+        {
+            frame.ignore = enter_directory(frame.ignore, path.substr(0, frame.path_len), ignore_files);
+        }
+
+        for (const auto &[name_off, type, link] : entries)
+        {
+            const char *name = names.c_str() + name_off;
+            path.resize(frame.path_len);
+            path.append(name);
+            if (is_ignored(frame.ignore, path, name, type == DT_DIR))
+            {
+                continue;
+            }
+
+            if (type == DT_DIR && link)
+            {
+                deferred_links.push_back(path);
+                continue;
+            }
+            if (type == DT_DIR)
+            {
+                frame.subdirs.emplace_back(name);
+                continue;
+            }
+
+            FileRecord rec;
+            rec.filename.assign(name);
+            rec.absolute_path = path;
+            rec.extension = extension_of(rec.filename);
+            add_file(std::move(rec));
+        }
+    };
+
+    std::vector<DirFrame> frames;
+    frames.push_back({root_fd, path.size(), {}, std::move(ignore)});
+    read_directory(frames.back());
+
+    while (!frames.empty())
+    {
+        checkpoint_if_due([&](std::vector<string> &pending)
+        {
+            for (const auto &frame : frames)
+            {
+                for (const auto &name : frame.subdirs)
+                {
+                    pending.push_back(path.substr(0, frame.path_len) + name);
+                }
+            }
+        });
+
+        DirFrame &top = frames.back();
+        if (top.subdirs.empty())
+        {
+            close(top.fd);
+            frames.pop_back();
+            continue;
+        }
+
+        string name = std::move(top.subdirs.back());
+        top.subdirs.pop_back();
+
+        int fd = openat(top.fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno != EACCES && errno != EPERM)
+            {
+                std::cerr << "Error accessing " << path.substr(0, top.path_len) << name << ": " << strerror(errno) << '\n';
+            }
+            continue;
+        }
+
+        path.resize(top.path_len);
+        path.append(name);
+        if (!identify_directory(fd, dev, ino, mount_root) || mount_root || !claim_directory(path, dev, ino))
+        {
+            if (mount_root)
+            {
+                deferred_links.push_back(path);
+            }
+            close(fd);
+            continue;
+        }
+        path.push_back('/');
+        frames.push_back({fd, path.size(), {}, top.ignore});
+        read_directory(frames.back());
+    }
+}
+
+#else
+
+void FileSystemCrawler::crawl_getdents(const string &root, IgnoreChain ignore)
+{
+    crawl_iterator(root, std::move(ignore));
+}
+
+#endif
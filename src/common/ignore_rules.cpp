@@ -0,0 +1,289 @@
+#include "ignore_rules.h"
+
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+bool has_wildcard(const std::string &s)
+{
+    return s.find_first_of("*?[\\") != std::string::npos;
+}
+
+bool ends_with(const char *s, const std::string &suffix)
+{
+    size_t len = std::strlen(s);
+    return len >= suffix.size() && std::memcmp(s + len - suffix.size(), suffix.data(), suffix.size()) == 0;
+}
+
+// [...] at pattern, against one character; advances pattern past the ']'.
+bool match_class(const char *&pattern, unsigned char c)
+{
+    const char *p = pattern + 1;
+    bool negate = *p == '!' || *p == '^';
+    if (negate)
+        p++;
+
+    bool matched = false;
+    bool first = true;
+    while (*p && (first || *p != ']'))
+    {
+        first = false;
+        unsigned char lo = *p;
+        if (lo == '\\' && p[1])
+            lo = *++p;
+        p++;
+        unsigned char hi = lo;
+        if (*p == '-' && p[1] && p[1] != ']')
+        {
+            p++;
+            if (*p == '\\' && p[1])
+                p++;
+            hi = *p++;
+        }
+        if (c >= lo && c <= hi)
+            matched = true;
+    }
+    if (*p != ']')
+        return false;
+    pattern = p + 1;
+    return matched != negate;
+}
+}
+
+// gitignore globbing: '*' and '?' stop at '/', "**/" spans any number of
+// directories and a trailing "**" matches everything below.
+bool glob_match(const char *pattern, const char *text)
+{
+    const char *p = pattern;
+    const char *t = text;
+    while (*p)
+    {
+        if (p[0] == '*' && p[1] == '*' && (p == pattern || p[-1] == '/'))
+        {
+            if (p[2] == '\0')
+                return true;
+            if (p[2] == '/')
+            {
+                const char *rest = p + 3;
+                if (glob_match(rest, t))
+                    return true;
+                for (const char *s = t; *s; s++)
+                {
+                    if (*s == '/' && glob_match(rest, s + 1))
+                        return true;
+                }
+                return false;
+            }
+        }
+
+        switch (*p)
+        {
+        case '*':
+            while (*p == '*')
+                p++;
+            for (const char *s = t;; s++)
+            {
+                if (glob_match(p, s))
+                    return true;
+                if (*s == '\0' || *s == '/')
+                    return false;
+            }
+        case '?':
+            if (*t == '\0' || *t == '/')
+                return false;
+            p++;
+            t++;
+            break;
+        case '[':
+            if (*t == '\0' || *t == '/' || !match_class(p, static_cast<unsigned char>(*t)))
+                return false;
+            t++;
+            break;
+        case '\\':
+            if (p[1])
+                p++;
+            // fall through
+        default:
+            if (*p != *t)
+                return false;
+            p++;
+            t++;
+        }
+    }
+    return *t == '\0';
+}
+
+// One line of an ignore file. Trailing spaces, blank lines and '#'
+// comments are skipped; "\#" and "\!" escape a leading '#' or '!'.
+void IgnoreRules::add(const std::string &line)
+{
+    std::string text = line;
+    while (!text.empty() && (text.back() == '\r' || text.back() == '\n'))
+        text.pop_back();
+    while (!text.empty() && text.back() == ' ' && !(text.size() > 1 && text[text.size() - 2] == '\\'))
+        text.pop_back();
+    if (text.empty() || text[0] == '#')
+        return;
+
+    Rule rule;
+    if (text[0] == '!')
+    {
+        rule.negate = true;
+        text.erase(0, 1);
+    }
+    else if (text[0] == '\\' && text.size() > 1 && (text[1] == '!' || text[1] == '#'))
+    {
+        text.erase(0, 1);
+    }
+
+    if (!text.empty() && text.back() == '/')
+    {
+        rule.dir_only = true;
+        text.pop_back();
+    }
+    if (text.compare(0, 3, "**/") == 0 && text.find('/', 3) == std::string::npos)
+        text.erase(0, 3);
+    if (text.find('/') != std::string::npos)
+    {
+        rule.anchored = true;
+        if (text[0] == '/')
+            text.erase(0, 1);
+    }
+    if (text.empty())
+        return;
+
+    std::string rest = text.substr(1);
+    std::string head = text.substr(0, text.size() - 1);
+    if (rule.anchored)
+        rule.kind = has_wildcard(text) ? Kind::Glob : Kind::Literal;
+    else if (!has_wildcard(text))
+        rule.kind = Kind::Literal;
+    else if (text[0] == '*' && !rest.empty() && !has_wildcard(rest))
+        rule.kind = rest[0] == '.' && rest.size() > 1 && rest.find('.', 1) == std::string::npos ? Kind::Extension : Kind::Suffix;
+    else if (text.back() == '*' && !head.empty() && !has_wildcard(head))
+        rule.kind = Kind::Prefix;
+    else
+        rule.kind = Kind::Glob;
+    rule.pattern = text;
+
+    int index = static_cast<int>(rules.size());
+    if (!rule.anchored && rule.kind == Kind::Literal)
+        literals[text].push_back(index);
+    else if (!rule.anchored && rule.kind == Kind::Extension)
+        extensions[rest.substr(1)].push_back(index);
+    else
+        scanned.push_back(index);
+    if (!rule.dir_only)
+        any_file_rules = true;
+    rules.push_back(std::move(rule));
+}
+
+bool IgnoreRules::load(const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+
+    std::string line;
+    while (std::getline(in, line))
+        add(line);
+    return true;
+}
+
+bool IgnoreRules::empty() const
+{
+    return rules.empty();
+}
+
+bool IgnoreRules::applies(const Rule &rule, const char *relative, const char *name, bool is_dir) const
+{
+    if (rule.dir_only && !is_dir)
+        return false;
+
+    switch (rule.kind)
+    {
+    case Kind::Literal:
+        return std::strcmp(rule.anchored ? relative : name, rule.pattern.c_str()) == 0;
+    case Kind::Extension:
+    case Kind::Suffix:
+        return ends_with(name, rule.pattern.substr(1));
+    case Kind::Prefix:
+        return std::strncmp(name, rule.pattern.c_str(), rule.pattern.size() - 1) == 0;
+    case Kind::Glob:
+        return glob_match(rule.pattern.c_str(), rule.anchored ? relative : name);
+    }
+    return false;
+}
+
+// The highest-numbered matching rule wins, so the tables only need to be
+// searched for a rule later than the best found so far.
+IgnoreMatch IgnoreRules::match(const char *relative, const char *name, bool is_dir) const
+{
+    if (!is_dir && !any_file_rules)
+        return IgnoreMatch::None;
+
+    int best = -1;
+    auto consider = [&](const std::vector<int> &indices)
+    {
+        for (auto it = indices.rbegin(); it != indices.rend() && *it > best; ++it)
+        {
+            if (applies(rules[*it], relative, name, is_dir))
+                best = *it;
+        }
+    };
+
+    if (!literals.empty())
+    {
+        auto it = literals.find(name);
+        if (it != literals.end())
+            consider(it->second);
+    }
+    if (!extensions.empty())
+    {
+        const char *dot = std::strrchr(name, '.');
+        if (dot)
+        {
+            auto it = extensions.find(dot + 1);
+            if (it != extensions.end())
+                consider(it->second);
+        }
+    }
+    consider(scanned);
+
+    if (best < 0)
+        return IgnoreMatch::None;
+    return rules[best].negate ? IgnoreMatch::Keep : IgnoreMatch::Ignore;
+}
+
+bool is_ignored(const IgnoreChain &chain, const std::string &path, const char *name, bool is_dir)
+{
+    for (const IgnoreLayer *layer = chain.get(); layer; layer = layer->parent.get())
+    {
+        // Paths outside a layer's directory can only meet its unanchored
+        // patterns, which look at the name alone.
+        const char *relative = path.compare(0, layer->base.size(), layer->base) == 0
+                                   ? path.c_str() + layer->base.size()
+                                   : name;
+        IgnoreMatch m = layer->rules.match(relative, name, is_dir);
+        if (m != IgnoreMatch::None)
+            return m == IgnoreMatch::Ignore;
+    }
+    return false;
+}
+
+IgnoreChain enter_directory(const IgnoreChain &parent, const std::string &dir_path,
+                            const std::vector<std::string> &ignore_files)
+{
+    auto layer = std::make_shared<IgnoreLayer>();
+    layer->base = dir_path;
+    if (layer->base.empty() || layer->base.back() != '/')
+        layer->base.push_back('/');
+    for (const auto &file : ignore_files)
+        layer->rules.load(layer->base + file);
+
+    if (layer->rules.empty())
+        return parent;
+    layer->parent = parent;
+    return layer;
+}
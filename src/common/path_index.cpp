@@ -0,0 +1,114 @@
+#include "path_index.h"
+#include "sqlite_wrapper.h"
+
+#include <functional>
+
+static constexpr size_t INITIAL_SLOTS = 1024;
+
+uint64_t PathIndex::hash_path(const std::string& path) {
+    uint64_t x = std::hash<std::string>()(path);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    // 0 marks an empty slot.
+    return x ? x : 1;
+}
+
+size_t PathIndex::home(uint64_t hash) const {
+    return hash & (slots.size() - 1);
+}
+
+void PathIndex::grow() {
+    std::vector<Slot> old = std::move(slots);
+    slots.assign(old.empty() ? INITIAL_SLOTS : old.size() * 2, Slot());
+    for (const auto& slot : old) {
+        if (slot.hash == 0) {
+            continue;
+        }
+        size_t i = home(slot.hash);
+        while (slots[i].hash != 0) {
+            i = (i + 1) & (slots.size() - 1);
+        }
+        slots[i] = slot;
+    }
+}
+
+int64_t PathIndex::find(const std::string& path) const {
+    if (slots.empty()) {
+        return -1;
+    }
+    uint64_t hash = hash_path(path);
+    for (size_t i = home(hash); slots[i].hash != 0; i = (i + 1) & (slots.size() - 1)) {
+        if (slots[i].hash == hash) {
+            return slots[i].fileid;
+        }
+    }
+    return -1;
+}
+
+void PathIndex::insert(const std::string& path, int64_t fileid) {
+    if ((count + 1) * 10 > slots.size() * 7) {
+        grow();
+    }
+    uint64_t hash = hash_path(path);
+    size_t i = home(hash);
+    while (slots[i].hash != 0 && slots[i].hash != hash) {
+        i = (i + 1) & (slots.size() - 1);
+    }
+    if (slots[i].hash == 0) {
+        count++;
+    }
+    slots[i] = {hash, fileid};
+}
+
+// Linear probing without tombstones: after emptying a slot, later entries
+// of the same cluster are shifted back into the gap if their home allows.
+void PathIndex::erase(const std::string& path) {
+    if (slots.empty()) {
+        return;
+    }
+    uint64_t hash = hash_path(path);
+    size_t mask = slots.size() - 1;
+    size_t i = home(hash);
+    while (slots[i].hash != hash) {
+        if (slots[i].hash == 0) {
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+
+    size_t gap = i;
+    for (size_t j = (gap + 1) & mask; slots[j].hash != 0; j = (j + 1) & mask) {
+        size_t h = home(slots[j].hash);
+        // Movable unless its home lies cyclically in (gap, j].
+        bool stays = gap <= j ? (gap < h && h <= j) : (gap < h || h <= j);
+        if (!stays) {
+            slots[gap] = slots[j];
+            gap = j;
+        }
+    }
+    slots[gap] = Slot();
+    count--;
+}
+
+void PathIndex::clear() {
+    slots.clear();
+    count = 0;
+}
+
+size_t PathIndex::size() const {
+    return count;
+}
+
+size_t PathIndex::memory_bytes() const {
+    return slots.capacity() * sizeof(Slot);
+}
+
+void PathIndex::load(const SQLiteWrapper& db) {
+    clear();
+    db.scan_paths([this](int64_t fileid, const char* path) {
+        insert(path, fileid);
+    });
+}
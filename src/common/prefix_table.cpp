@@ -0,0 +1,211 @@
+#include "prefix_table.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+static const char PREFIX_TABLE_MAGIC[8] = {'S', 'P', 'P', 'F', 'X', '\0', '\0', '\0'};
+static const uint32_t PREFIX_TABLE_VERSION = 1;
+
+namespace {
+struct Candidate {
+    uint32_t name_length;
+    uint32_t path_length;
+    uint32_t fileid;
+};
+
+// The order the trie's breadth-first walk reaches names in, with ties
+// broken by the shallower path.
+bool shorter(const Candidate& a, const Candidate& b) {
+    if (a.name_length != b.name_length) {
+        return a.name_length < b.name_length;
+    }
+    if (a.path_length != b.path_length) {
+        return a.path_length < b.path_length;
+    }
+    return a.fileid < b.fileid;
+}
+
+template <typename T>
+void write_vector(std::ofstream& out, const std::vector<T>& v) {
+    uint64_t n = v.size();
+    out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+    out.write(reinterpret_cast<const char*>(v.data()), n * sizeof(T));
+}
+
+template <typename T>
+bool read_vector(std::ifstream& in, std::vector<T>& v) {
+    uint64_t n = 0;
+    in.read(reinterpret_cast<char*>(&n), sizeof(n));
+    if (!in || n > (uint64_t(1) << 40) / sizeof(T)) {
+        return false;
+    }
+    v.resize(n);
+    in.read(reinterpret_cast<char*>(v.data()), n * sizeof(T));
+    return static_cast<bool>(in);
+}
+}
+
+// Length in the top byte, then the case-folded bytes, so one- and
+// two-character keys sort apart from longer ones they are prefixes of.
+uint32_t PrefixTable::key_of(const char* prefix, size_t length) {
+    uint32_t key = static_cast<uint32_t>(length) << 24;
+    for (size_t i = 0; i < length; i++) {
+        key |= static_cast<uint32_t>(std::tolower(static_cast<unsigned char>(prefix[i]))) << (16 - 8 * i);
+    }
+    return key;
+}
+
+// Each filename feeds the bounded heaps of its leading one to MAX_PREFIX
+// bytes in a single scan of the database; the token lists are ordinary
+// token index searches, one per prefix its dictionary holds.
+void PrefixTable::build(const SQLiteWrapper& db, const TokenIndex& tokens) {
+    std::unordered_map<uint32_t, std::vector<Candidate>> heaps;
+    db.scan_paths([&](int64_t fileid, const char* path) {
+        if (fileid < 0 || fileid >= UINT32_MAX) {
+            return;
+        }
+        const char* slash = std::strrchr(path, '/');
+        const char* name = slash ? slash + 1 : path;
+        size_t name_length = std::strlen(name);
+        Candidate candidate{static_cast<uint32_t>(name_length), static_cast<uint32_t>(name - path + name_length),
+                            static_cast<uint32_t>(fileid)};
+
+        for (size_t length = 1; length <= MAX_PREFIX && length <= name_length; length++) {
+            std::vector<Candidate>& heap = heaps[key_of(name, length)];
+            if (heap.size() < TOP_K) {
+                heap.push_back(candidate);
+                std::push_heap(heap.begin(), heap.end(), shorter);
+            } else if (shorter(candidate, heap.front())) {
+                std::pop_heap(heap.begin(), heap.end(), shorter);
+                heap.back() = candidate;
+                std::push_heap(heap.begin(), heap.end(), shorter);
+            }
+        }
+    });
+
+    std::unordered_map<uint32_t, std::vector<TokenIndex::Match>> matches;
+    for (const auto& prefix : tokens.prefixes(MAX_PREFIX)) {
+        matches[key_of(prefix.data(), prefix.size())] = tokens.search({prefix}, TOP_K);
+    }
+
+    std::vector<uint32_t> keys;
+    for (const auto& [key, heap] : heaps) {
+        keys.push_back(key);
+    }
+    for (const auto& [key, list] : matches) {
+        if (heaps.find(key) == heaps.end()) {
+            keys.push_back(key);
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+
+    entries.clear();
+    name_ids.clear();
+    token_ids.clear();
+    token_ranks.clear();
+    for (uint32_t key : keys) {
+        Entry entry{key, static_cast<uint32_t>(name_ids.size()), static_cast<uint32_t>(token_ids.size()), 0, 0};
+        auto heap = heaps.find(key);
+        if (heap != heaps.end()) {
+            std::sort_heap(heap->second.begin(), heap->second.end(), shorter);
+            for (const auto& candidate : heap->second) {
+                name_ids.push_back(candidate.fileid);
+            }
+            entry.names = static_cast<uint8_t>(heap->second.size());
+        }
+        auto list = matches.find(key);
+        if (list != matches.end()) {
+            for (const auto& match : list->second) {
+                token_ids.push_back(static_cast<uint32_t>(match.fileid));
+                token_ranks.push_back(static_cast<float>(match.rank));
+            }
+            entry.tokens = static_cast<uint8_t>(list->second.size());
+        }
+        entries.push_back(entry);
+    }
+}
+
+bool PrefixTable::empty() const {
+    return entries.empty();
+}
+
+bool PrefixTable::lookup(const std::string& prefix, std::vector<int64_t>& names,
+                         std::vector<TokenIndex::Match>& tokens) const {
+    names.clear();
+    tokens.clear();
+    if (entries.empty() || prefix.empty() || prefix.size() > MAX_PREFIX) {
+        return false;
+    }
+
+    uint32_t key = key_of(prefix.data(), prefix.size());
+    auto it = std::lower_bound(entries.begin(), entries.end(), key,
+                               [](const Entry& entry, uint32_t k) { return entry.key < k; });
+    if (it == entries.end() || it->key != key) {
+        return true;
+    }
+    for (uint32_t i = 0; i < it->names; i++) {
+        names.push_back(name_ids[it->names_offset + i]);
+    }
+    for (uint32_t i = 0; i < it->tokens; i++) {
+        tokens.push_back({token_ids[it->tokens_offset + i], token_ranks[it->tokens_offset + i]});
+    }
+    return true;
+}
+
+void PrefixTable::save(const std::string& filename) const {
+    std::ofstream out(filename, std::ios::binary);
+    if (!out) {
+        std::cerr << "Error opening file for writing: " << filename << std::endl;
+        return;
+    }
+
+    out.write(PREFIX_TABLE_MAGIC, sizeof(PREFIX_TABLE_MAGIC));
+    out.write(reinterpret_cast<const char*>(&PREFIX_TABLE_VERSION), sizeof(PREFIX_TABLE_VERSION));
+    write_vector(out, entries);
+    write_vector(out, name_ids);
+    write_vector(out, token_ids);
+    write_vector(out, token_ranks);
+}
+
+bool PrefixTable::load(const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) {
+        std::cerr << "Error opening file for reading: " << filename << std::endl;
+        return false;
+    }
+
+    char magic[sizeof(PREFIX_TABLE_MAGIC)];
+    uint32_t version = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    if (!in || std::memcmp(magic, PREFIX_TABLE_MAGIC, sizeof(magic)) != 0 || version != PREFIX_TABLE_VERSION) {
+        std::cerr << "Unsupported prefix table format in " << filename << std::endl;
+        return false;
+    }
+
+    PrefixTable loaded;
+    if (!read_vector(in, loaded.entries) || !read_vector(in, loaded.name_ids) ||
+        !read_vector(in, loaded.token_ids) || !read_vector(in, loaded.token_ranks)) {
+        std::cerr << "Truncated prefix table " << filename << std::endl;
+        return false;
+    }
+
+    // Lookups binary-search the keys and index the arrays unchecked.
+    for (size_t i = 0; i < loaded.entries.size(); i++) {
+        const Entry& entry = loaded.entries[i];
+        if ((i > 0 && loaded.entries[i - 1].key >= entry.key) ||
+            static_cast<uint64_t>(entry.names_offset) + entry.names > loaded.name_ids.size() ||
+            static_cast<uint64_t>(entry.tokens_offset) + entry.tokens > loaded.token_ids.size() ||
+            loaded.token_ranks.size() != loaded.token_ids.size()) {
+            std::cerr << "Corrupt prefix table " << filename << std::endl;
+            return false;
+        }
+    }
+
+    *this = std::move(loaded);
+    return true;
+}
@@ -0,0 +1,298 @@
+#include "roaring_bitmap.h"
+
+#include <algorithm>
+
+static constexpr size_t BITMAP_WORDS = 65536 / 64;
+
+bool RoaringBitmap::Container::contains(uint16_t low) const {
+    if (is_bitmap()) {
+        return (bits[low >> 6] >> (low & 63)) & 1;
+    }
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+bool RoaringBitmap::Container::add(uint16_t low) {
+    if (is_bitmap()) {
+        uint64_t mask = uint64_t(1) << (low & 63);
+        if (bits[low >> 6] & mask) {
+            return false;
+        }
+        bits[low >> 6] |= mask;
+        cardinality++;
+        return true;
+    }
+
+    auto it = std::lower_bound(array.begin(), array.end(), low);
+    if (it != array.end() && *it == low) {
+        return false;
+    }
+    array.insert(it, low);
+    cardinality++;
+    if (cardinality > ARRAY_LIMIT) {
+        to_bitmap();
+    }
+    return true;
+}
+
+bool RoaringBitmap::Container::remove(uint16_t low) {
+    if (is_bitmap()) {
+        uint64_t mask = uint64_t(1) << (low & 63);
+        if (!(bits[low >> 6] & mask)) {
+            return false;
+        }
+        bits[low >> 6] &= ~mask;
+        cardinality--;
+        if (cardinality <= ARRAY_LIMIT) {
+            to_array();
+        }
+        return true;
+    }
+
+    auto it = std::lower_bound(array.begin(), array.end(), low);
+    if (it == array.end() || *it != low) {
+        return false;
+    }
+    array.erase(it);
+    cardinality--;
+    return true;
+}
+
+void RoaringBitmap::Container::to_bitmap() {
+    bits.assign(BITMAP_WORDS, 0);
+    for (uint16_t low : array) {
+        bits[low >> 6] |= uint64_t(1) << (low & 63);
+    }
+    array.clear();
+    array.shrink_to_fit();
+}
+
+void RoaringBitmap::Container::to_array() {
+    array.clear();
+    array.reserve(cardinality);
+    for (size_t w = 0; w < bits.size(); w++) {
+        uint64_t word = bits[w];
+        while (word) {
+            array.push_back(static_cast<uint16_t>(w * 64 + __builtin_ctzll(word)));
+            word &= word - 1;
+        }
+    }
+    bits.clear();
+    bits.shrink_to_fit();
+}
+
+RoaringBitmap::Container* RoaringBitmap::find_container(uint16_t key) {
+    auto it = std::lower_bound(containers.begin(), containers.end(), key,
+                               [](const Container& c, uint16_t k) { return c.key < k; });
+    return (it != containers.end() && it->key == key) ? &*it : nullptr;
+}
+
+const RoaringBitmap::Container* RoaringBitmap::find_container(uint16_t key) const {
+    auto it = std::lower_bound(containers.begin(), containers.end(), key,
+                               [](const Container& c, uint16_t k) { return c.key < k; });
+    return (it != containers.end() && it->key == key) ? &*it : nullptr;
+}
+
+void RoaringBitmap::add(uint32_t value) {
+    uint16_t key = static_cast<uint16_t>(value >> 16);
+    auto it = std::lower_bound(containers.begin(), containers.end(), key,
+                               [](const Container& c, uint16_t k) { return c.key < k; });
+    if (it == containers.end() || it->key != key) {
+        Container c;
+        c.key = key;
+        it = containers.insert(it, std::move(c));
+    }
+    it->add(static_cast<uint16_t>(value & 0xFFFF));
+}
+
+void RoaringBitmap::remove(uint32_t value) {
+    uint16_t key = static_cast<uint16_t>(value >> 16);
+    Container* c = find_container(key);
+    if (!c) {
+        return;
+    }
+    c->remove(static_cast<uint16_t>(value & 0xFFFF));
+    if (c->cardinality == 0) {
+        containers.erase(containers.begin() + (c - containers.data()));
+    }
+}
+
+bool RoaringBitmap::contains(uint32_t value) const {
+    const Container* c = find_container(static_cast<uint16_t>(value >> 16));
+    return c && c->contains(static_cast<uint16_t>(value & 0xFFFF));
+}
+
+uint64_t RoaringBitmap::cardinality() const {
+    uint64_t total = 0;
+    for (const auto& c : containers) {
+        total += c.cardinality;
+    }
+    return total;
+}
+
+bool RoaringBitmap::empty() const {
+    return containers.empty();
+}
+
+RoaringBitmap::Container RoaringBitmap::and_containers(const Container& a, const Container& b) {
+    Container out;
+    out.key = a.key;
+
+    if (a.is_bitmap() && b.is_bitmap()) {
+        out.bits.resize(BITMAP_WORDS);
+        uint32_t card = 0;
+        for (size_t w = 0; w < BITMAP_WORDS; w++) {
+            out.bits[w] = a.bits[w] & b.bits[w];
+            card += __builtin_popcountll(out.bits[w]);
+        }
+        out.cardinality = card;
+        if (card <= ARRAY_LIMIT) {
+            out.to_array();
+        }
+        return out;
+    }
+
+    if (a.is_bitmap() || b.is_bitmap()) {
+        const Container& arr = a.is_bitmap() ? b : a;
+        const Container& bmp = a.is_bitmap() ? a : b;
+        for (uint16_t low : arr.array) {
+            if (bmp.contains(low)) {
+                out.array.push_back(low);
+            }
+        }
+        out.cardinality = static_cast<uint32_t>(out.array.size());
+        return out;
+    }
+
+    std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                          std::back_inserter(out.array));
+    out.cardinality = static_cast<uint32_t>(out.array.size());
+    return out;
+}
+
+RoaringBitmap::Container RoaringBitmap::or_containers(const Container& a, const Container& b) {
+    Container out;
+    out.key = a.key;
+
+    if (a.is_bitmap() || b.is_bitmap() || a.cardinality + b.cardinality > ARRAY_LIMIT) {
+        Container x = a, y = b;
+        if (!x.is_bitmap()) x.to_bitmap();
+        if (!y.is_bitmap()) y.to_bitmap();
+        out.bits.resize(BITMAP_WORDS);
+        uint32_t card = 0;
+        for (size_t w = 0; w < BITMAP_WORDS; w++) {
+            out.bits[w] = x.bits[w] | y.bits[w];
+            card += __builtin_popcountll(out.bits[w]);
+        }
+        out.cardinality = card;
+        if (card <= ARRAY_LIMIT) {
+            out.to_array();
+        }
+        return out;
+    }
+
+    std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                   std::back_inserter(out.array));
+    out.cardinality = static_cast<uint32_t>(out.array.size());
+    return out;
+}
+
+RoaringBitmap RoaringBitmap::operator&(const RoaringBitmap& other) const {
+    RoaringBitmap out;
+    size_t i = 0, j = 0;
+    while (i < containers.size() && j < other.containers.size()) {
+        const Container& a = containers[i];
+        const Container& b = other.containers[j];
+        if (a.key < b.key) {
+            i++;
+        } else if (b.key < a.key) {
+            j++;
+        } else {
+            Container c = and_containers(a, b);
+            if (c.cardinality > 0) {
+                out.containers.push_back(std::move(c));
+            }
+            i++;
+            j++;
+        }
+    }
+    return out;
+}
+
+RoaringBitmap RoaringBitmap::operator|(const RoaringBitmap& other) const {
+    RoaringBitmap out;
+    size_t i = 0, j = 0;
+    while (i < containers.size() || j < other.containers.size()) {
+        if (j == other.containers.size() || (i < containers.size() && containers[i].key < other.containers[j].key)) {
+            out.containers.push_back(containers[i++]);
+        } else if (i == containers.size() || other.containers[j].key < containers[i].key) {
+            out.containers.push_back(other.containers[j++]);
+        } else {
+            out.containers.push_back(or_containers(containers[i++], other.containers[j++]));
+        }
+    }
+    return out;
+}
+
+void RoaringBitmap::for_each(const std::function<bool(uint32_t)>& visit) const {
+    for (const auto& c : containers) {
+        uint32_t high = uint32_t(c.key) << 16;
+        if (c.is_bitmap()) {
+            for (size_t w = 0; w < c.bits.size(); w++) {
+                uint64_t word = c.bits[w];
+                while (word) {
+                    if (!visit(high | static_cast<uint32_t>(w * 64 + __builtin_ctzll(word)))) {
+                        return;
+                    }
+                    word &= word - 1;
+                }
+            }
+        } else {
+            for (uint16_t low : c.array) {
+                if (!visit(high | low)) {
+                    return;
+                }
+            }
+        }
+    }
+}
+
+void RoaringBitmap::write(std::ofstream& out) const {
+    uint32_t count = static_cast<uint32_t>(containers.size());
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (const auto& c : containers) {
+        uint8_t bitmap = c.is_bitmap();
+        out.write(reinterpret_cast<const char*>(&c.key), sizeof(c.key));
+        out.write(reinterpret_cast<const char*>(&bitmap), sizeof(bitmap));
+        out.write(reinterpret_cast<const char*>(&c.cardinality), sizeof(c.cardinality));
+        if (bitmap) {
+            out.write(reinterpret_cast<const char*>(c.bits.data()), c.bits.size() * sizeof(uint64_t));
+        } else {
+            out.write(reinterpret_cast<const char*>(c.array.data()), c.array.size() * sizeof(uint16_t));
+        }
+    }
+}
+
+bool RoaringBitmap::read(std::ifstream& in) {
+    containers.clear();
+    uint32_t count = 0;
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    for (uint32_t i = 0; i < count && in; i++) {
+        Container c;
+        uint8_t bitmap = 0;
+        in.read(reinterpret_cast<char*>(&c.key), sizeof(c.key));
+        in.read(reinterpret_cast<char*>(&bitmap), sizeof(bitmap));
+        in.read(reinterpret_cast<char*>(&c.cardinality), sizeof(c.cardinality));
+        if (bitmap) {
+            c.bits.resize(BITMAP_WORDS);
+            in.read(reinterpret_cast<char*>(c.bits.data()), c.bits.size() * sizeof(uint64_t));
+        } else {
+            if (c.cardinality > ARRAY_LIMIT) {
+                return false;
+            }
+            c.array.resize(c.cardinality);
+            in.read(reinterpret_cast<char*>(c.array.data()), c.array.size() * sizeof(uint16_t));
+        }
+        containers.push_back(std::move(c));
+    }
+    return static_cast<bool>(in);
+}
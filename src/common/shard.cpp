@@ -0,0 +1,151 @@
+#include "shard.h"
+
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+const std::string REBUILD_MARKER = "rebuild";
+
+// "/mnt/nas/photos" -> "mnt_nas_photos"; the filesystem root is "root".
+std::string shard_name(const std::string &root)
+{
+    std::string name;
+    for (char c : root)
+    {
+        if (c == '/')
+        {
+            if (!name.empty() && name.back() != '_')
+                name.push_back('_');
+        }
+        else
+        {
+            name.push_back(c);
+        }
+    }
+    while (!name.empty() && name.back() == '_')
+        name.pop_back();
+    return name.empty() ? "root" : name;
+}
+}
+
+ShardLayout shard_layout(const SpotlightConfig &config, const std::string &root)
+{
+    ShardLayout shard;
+    shard.root = fs::path(root).lexically_normal().string();
+    if (shard.root.size() > 1 && shard.root.back() == '/')
+        shard.root.pop_back();
+    shard.name = shard_name(shard.root);
+
+    fs::path dir = fs::path(config.index_dir) / "shards" / shard.name;
+    shard.directory = dir.string();
+    shard.db_path = (dir / "crawl.db").string();
+    shard.trie_path = (dir / "trie.dat").string();
+    shard.ext_index_path = (dir / "ext_index.dat").string();
+    shard.token_index_path = (dir / "tokens.dat").string();
+    shard.dir_index_path = (dir / "dirs.dat").string();
+    shard.prefix_table_path = (dir / "prefixes.dat").string();
+    shard.spill_path = (dir / "trie.spill").string();
+    shard.checkpoint_path = (dir / "crawl.checkpoint").string();
+    shard.frecency_path = (dir / "frecency.dat").string();
+    shard.snapshot_path = (dir / "snapshot").string();
+    return shard;
+}
+
+std::vector<ShardLayout> shard_layouts(const SpotlightConfig &config)
+{
+    std::vector<ShardLayout> shards;
+    for (const auto &root : config.roots)
+    {
+        ShardLayout shard = shard_layout(config, root);
+        bool duplicate = false;
+        for (const auto &existing : shards)
+        {
+            if (existing.name == shard.name)
+                duplicate = true;
+        }
+        if (!duplicate)
+            shards.push_back(std::move(shard));
+    }
+    return shards;
+}
+
+std::vector<std::string> shard_ignore_rules(const SpotlightConfig &config, const ShardLayout &shard)
+{
+    std::vector<std::string> patterns = config.ignore;
+
+    std::error_code ec;
+    fs::path shards = fs::absolute(fs::path(config.index_dir) / "shards", ec).lexically_normal();
+    std::string relative = shards.lexically_relative(shard.root).string();
+    if (ec || relative.empty() || relative == "." || relative.compare(0, 2, "..") == 0)
+        return patterns;
+
+    // Anchored to the root and escaped, so no part of the path is read as
+    // a wildcard. Added last, so no configured '!' rule re-includes it.
+    std::string pattern = "/";
+    for (char c : relative)
+    {
+        if (c == '\\' || c == '*' || c == '?' || c == '[')
+            pattern.push_back('\\');
+        pattern.push_back(c);
+    }
+    pattern.push_back('/');
+    patterns.push_back(pattern);
+    return patterns;
+}
+
+bool request_rebuild(const ShardLayout &shard)
+{
+    std::error_code ec;
+    fs::create_directories(shard.directory, ec);
+    std::ofstream marker(fs::path(shard.directory) / REBUILD_MARKER);
+    return static_cast<bool>(marker);
+}
+
+bool take_rebuild_request(const ShardLayout &shard)
+{
+    std::error_code ec;
+    return fs::remove(fs::path(shard.directory) / REBUILD_MARKER, ec);
+}
+
+bool write_snapshot_stamp(const ShardLayout &shard, const SnapshotStamp &stamp)
+{
+    std::string staged = shard.snapshot_path + ".tmp";
+    {
+        std::ofstream out(staged, std::ios::trunc);
+        out << "generation " << stamp.generation << '\n' << "database " << stamp.database_id << '\n';
+        if (!out.flush())
+            return false;
+    }
+    std::error_code ec;
+    fs::rename(staged, shard.snapshot_path, ec);
+    return !ec;
+}
+
+bool read_snapshot_stamp(const ShardLayout &shard, SnapshotStamp &stamp)
+{
+    std::ifstream in(shard.snapshot_path);
+    std::string field, database;
+    uint64_t generation = 0;
+    if (!(in >> field >> generation) || field != "generation")
+        return false;
+    if (!(in >> field >> database) || field != "database")
+        database.clear();
+    stamp.generation = generation;
+    stamp.database_id = database;
+    return true;
+}
+
+void remove_shard_files(const ShardLayout &shard)
+{
+    // A WAL left behind would be replayed into the next database created
+    // at db_path.
+    std::error_code ec;
+    for (const auto &path : {shard.db_path, shard.db_path + "-wal", shard.db_path + "-shm", shard.trie_path,
+                             shard.ext_index_path, shard.token_index_path, shard.dir_index_path,
+                             shard.prefix_table_path, shard.spill_path, shard.checkpoint_path, shard.frecency_path,
+                             shard.snapshot_path})
+        fs::remove(path, ec);
+}
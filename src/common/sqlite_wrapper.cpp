@@ -5,9 +5,35 @@
 namespace fs = std::filesystem;
 static const std::string DEFAULT_DB_PATH = "/home/a7x/crawl.db";
 
-SQLiteWrapper::SQLiteWrapper(const std::string &path)
+// File contents live in their own contentless FTS table keyed by docid, not
+// fileid: without contentless_delete a changed file's old postings can't be
+// removed, so its content_docs row is dropped (orphaning them) and the new
+// text gets a fresh docid. Orphans are cleared by reset_content_index().
+static const char *CONTENT_SCHEMA =
+    "CREATE TABLE IF NOT EXISTS content_docs ("
+    "    docid INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "    fileid INTEGER NOT NULL UNIQUE,"
+    "    mtime INTEGER NOT NULL,"
+    "    is_text INTEGER NOT NULL"
+    ");"
+    "CREATE VIRTUAL TABLE IF NOT EXISTS content_fts "
+    "USING fts5(body, content='', tokenize='porter unicode61');";
+
+// A random id drawn when the database is created. Fileids are only
+// meaningful within one database, and a rebuild starts them over, so the
+// indexer records the id beside the snapshots it saves.
+static const char *META_SCHEMA =
+    "CREATE TABLE IF NOT EXISTS meta ("
+    "    key TEXT PRIMARY KEY,"
+    "    value TEXT NOT NULL"
+    ");"
+    "INSERT OR IGNORE INTO meta (key, value) VALUES ('database_id', lower(hex(randomblob(8))));";
+
+SQLiteWrapper::SQLiteWrapper(const std::string &path, bool read_only) : read_only(read_only)
 {
     db_path = path.empty() ? DEFAULT_DB_PATH : path;
+    if (read_only)
+        return;
 
     if (!exists())
     {
@@ -15,12 +41,13 @@ SQLiteWrapper::SQLiteWrapper(const std::string &path)
         return;
     }
 
+    // Missing tables are created in place. A failed check is as likely a
+    // locked or briefly unreadable file as a broken one, so the database is
+    // never thrown away here; "indexer --rebuild" is the way to start over.
     if (!check_tables())
-    {
-        std::error_code ec;
-        fs::remove(db_path, ec);
         init_tables();
-    }
+
+    upgrade_tables();
 }
 
 bool SQLiteWrapper::exists() const
@@ -30,9 +57,8 @@ bool SQLiteWrapper::exists() const
 
 bool SQLiteWrapper::check_tables() const
 {
-    sqlite3 *db = nullptr;
-    int rc = sqlite3_open(db_path.c_str(), &db);
-    if (rc != SQLITE_OK)
+    sqlite3 *db = open_db();
+    if (!db)
         return false;
 
     const char *sql =
@@ -41,10 +67,9 @@ bool SQLiteWrapper::check_tables() const
         "AND name IN ('index_table', 'fts_index');";
 
     sqlite3_stmt *stmt = nullptr;
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-    if (rc != SQLITE_OK)
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
     {
-        sqlite3_close(db);
+        close_db(db);
         return false;
     }
 
@@ -53,44 +78,118 @@ bool SQLiteWrapper::check_tables() const
         count++;
 
     sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    close_db(db);
     return (count == 2);
 }
 
 void SQLiteWrapper::init_tables()
 {
-    sqlite3 *db = nullptr;
-    int rc = sqlite3_open(db_path.c_str(), &db);
-    if (rc != SQLITE_OK)
+    sqlite3 *db = open_db();
+    if (!db)
         return;
 
-    sqlite3_exec(db, "PRAGMA foreign_keys = ON;", nullptr, nullptr, nullptr);
-    sqlite3_exec(db, "PRAGMA synchronous = OFF;", nullptr, nullptr, nullptr);
-    sqlite3_exec(db, "PRAGMA journal_mode = MEMORY;", nullptr, nullptr, nullptr);
+    // auto_vacuum only takes effect before the first table exists; the
+    // journal mode is stored in the file, so it is set once for everyone.
+    sqlite3_exec(db, "PRAGMA auto_vacuum = INCREMENTAL;", nullptr, nullptr, nullptr);
+    sqlite3_exec(db, "PRAGMA journal_mode = WAL;", nullptr, nullptr, nullptr);
 
     const char *sql =
         "CREATE TABLE IF NOT EXISTS index_table ("
         "    fileid INTEGER PRIMARY KEY AUTOINCREMENT,"
         "    filename TEXT NOT NULL,"
         "    absolute_path TEXT NOT NULL UNIQUE,"
-        "    extension TEXT"
+        "    extension TEXT,"
+        "    size INTEGER NOT NULL DEFAULT 0,"
+        "    mtime INTEGER NOT NULL DEFAULT 0,"
+        "    uid INTEGER NOT NULL DEFAULT 0,"
+        "    generation INTEGER NOT NULL DEFAULT 0"
         ");"
+        "CREATE INDEX IF NOT EXISTS idx_index_table_extension ON index_table(extension);"
+        "CREATE INDEX IF NOT EXISTS idx_index_table_generation ON index_table(generation);"
         "CREATE VIRTUAL TABLE IF NOT EXISTS fts_index "
         "USING fts5(tokens, content='', tokenize='porter unicode61');";
 
     char *err = nullptr;
-    rc = sqlite3_exec(db, sql, nullptr, nullptr, &err);
+    int rc = sqlite3_exec(db, sql, nullptr, nullptr, &err);
     if (rc != SQLITE_OK)
         sqlite3_free(err);
+    sqlite3_exec(db, CONTENT_SCHEMA, nullptr, nullptr, nullptr);
+    sqlite3_exec(db, META_SCHEMA, nullptr, nullptr, nullptr);
 
-    sqlite3_close(db);
+    close_db(db);
+}
+
+// Databases created before a column was introduced get it added in place
+// instead of being dropped and re-crawled.
+void SQLiteWrapper::upgrade_tables()
+{
+    sqlite3 *db = open_db();
+    if (!db)
+        return;
+
+    // Databases from before WAL mode are switched over on first open.
+    sqlite3_exec(db, "PRAGMA journal_mode = WAL;", nullptr, nullptr, nullptr);
+
+    std::unordered_set<std::string> columns;
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "PRAGMA table_info(index_table);", -1, &stmt, nullptr) == SQLITE_OK)
+    {
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+            columns.insert(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)));
+        sqlite3_finalize(stmt);
+    }
+
+    static const std::pair<const char*, const char*> added_columns[] = {
+        {"size", "ALTER TABLE index_table ADD COLUMN size INTEGER NOT NULL DEFAULT 0;"},
+        {"mtime", "ALTER TABLE index_table ADD COLUMN mtime INTEGER NOT NULL DEFAULT 0;"},
+        {"uid", "ALTER TABLE index_table ADD COLUMN uid INTEGER NOT NULL DEFAULT 0;"},
+        {"generation", "ALTER TABLE index_table ADD COLUMN generation INTEGER NOT NULL DEFAULT 0;"},
+    };
+
+    for (const auto &[name, sql] : added_columns)
+    {
+        if (!columns.count(name))
+            sqlite3_exec(db, sql, nullptr, nullptr, nullptr);
+    }
+
+    sqlite3_exec(db, "CREATE INDEX IF NOT EXISTS idx_index_table_extension ON index_table(extension);",
+                 nullptr, nullptr, nullptr);
+    sqlite3_exec(db, "CREATE INDEX IF NOT EXISTS idx_index_table_generation ON index_table(generation);",
+                 nullptr, nullptr, nullptr);
+    sqlite3_exec(db, CONTENT_SCHEMA, nullptr, nullptr, nullptr);
+    sqlite3_exec(db, META_SCHEMA, nullptr, nullptr, nullptr);
+
+    close_db(db);
+}
+
+// Every connection reads through mmap and waits out a briefly held lock
+// instead of failing with SQLITE_BUSY. None checkpoints on commit or on
+// close: with each call opening its own connection, the last one to close
+// would otherwise fold the whole WAL back in on the caller's time. Writers
+// sync only at checkpoints, which WAL makes safe against torn writes.
+void SQLiteWrapper::configure(sqlite3 *db, bool writer)
+{
+    sqlite3_busy_timeout(db, BUSY_TIMEOUT_MS);
+    sqlite3_db_config(db, SQLITE_DBCONFIG_NO_CKPT_ON_CLOSE, 1, nullptr);
+    std::string mmap = "PRAGMA mmap_size = " + std::to_string(MMAP_SIZE) + ";";
+    sqlite3_exec(db, mmap.c_str(), nullptr, nullptr, nullptr);
+    if (writer)
+    {
+        sqlite3_exec(db, "PRAGMA synchronous = NORMAL;", nullptr, nullptr, nullptr);
+        sqlite3_exec(db, "PRAGMA wal_autocheckpoint = 0;", nullptr, nullptr, nullptr);
+    }
 }
 
 sqlite3 *SQLiteWrapper::open_db() const
 {
     sqlite3 *db = nullptr;
-    if (sqlite3_open(db_path.c_str(), &db) != SQLITE_OK)
+    int flags = read_only ? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+    if (sqlite3_open_v2(db_path.c_str(), &db, flags, nullptr) != SQLITE_OK)
+    {
+        sqlite3_close(db);
         return nullptr;
+    }
+    configure(db, !read_only);
     return db;
 }
 
@@ -100,6 +199,24 @@ void SQLiteWrapper::close_db(sqlite3 *db) const
         sqlite3_close(db);
 }
 
+bool SQLiteWrapper::checkpoint(const std::string &path, bool truncate)
+{
+    sqlite3 *db = nullptr;
+    if (sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK)
+    {
+        sqlite3_close(db);
+        return false;
+    }
+    configure(db, true);
+
+    int wal_frames = 0;
+    int copied = 0;
+    int rc = sqlite3_wal_checkpoint_v2(db, nullptr, truncate ? SQLITE_CHECKPOINT_TRUNCATE : SQLITE_CHECKPOINT_PASSIVE,
+                                       &wal_frames, &copied);
+    sqlite3_close(db);
+    return rc == SQLITE_OK && copied == wal_frames;
+}
+
 int SQLiteWrapper::insert_file(const std::string &filename,
                                const std::string &abs_path,
                                const std::string &ext)
@@ -176,7 +293,26 @@ bool SQLiteWrapper::insert_token(const std::string &token, int fileid)
     return ok;
 }
 
-void SQLiteWrapper::batch_insert_files(std::vector<FileRecord> &files)
+// fts_index is contentless, so deleting a row means handing FTS5 the same
+// tokens it was given on insert; they are rebuilt from the path with the
+// crawler's tokenizer.
+static std::string token_text(const std::unordered_set<std::string> &tokens)
+{
+    // Concatenate all tokens into a single string
+    std::string all_tokens;
+    for (const auto &token : tokens)
+    {
+        all_tokens += token + " ";
+    }
+    return all_tokens;
+}
+
+// Records that arrive with a fileid were recognised by the caller's path
+// index. They are refreshed by rowid, with the stored path compared as a
+// check against hash collisions. Anything else, including a failed check,
+// goes through the upsert. last_insert_rowid moves only when a new row was
+// actually inserted, and only those rows get FTS tokens.
+void SQLiteWrapper::batch_insert_files(std::vector<FileRecord> &files, int64_t generation)
 {
     sqlite3 *db = open_db();
     if (!db)
@@ -184,34 +320,66 @@ void SQLiteWrapper::batch_insert_files(std::vector<FileRecord> &files)
 
     sqlite3_exec(db, "BEGIN TRANSACTION;", nullptr, nullptr, nullptr);
 
+    const char *known_sql =
+        "UPDATE index_table SET size = ?, mtime = ?, uid = ?, generation = ?, extension = ? "
+        "WHERE fileid = ? AND absolute_path = ?;";
     const char *file_sql =
-        "INSERT INTO index_table (filename, absolute_path, extension) "
-        "VALUES (?, ?, ?);";
+        "INSERT INTO index_table (filename, absolute_path, extension, size, mtime, uid, generation) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?) "
+        "ON CONFLICT(absolute_path) DO UPDATE SET "
+        "size = excluded.size, mtime = excluded.mtime, uid = excluded.uid, generation = excluded.generation, "
+        "extension = excluded.extension "
+        "RETURNING fileid;";
     const char *token_sql =
         "INSERT INTO fts_index(rowid, tokens) VALUES (?, ?);";
 
+    sqlite3_stmt *known_stmt;
     sqlite3_stmt *file_stmt;
     sqlite3_stmt *token_stmt;
 
+    sqlite3_prepare_v2(db, known_sql, -1, &known_stmt, nullptr);
     sqlite3_prepare_v2(db, file_sql, -1, &file_stmt, nullptr);
     sqlite3_prepare_v2(db, token_sql, -1, &token_stmt, nullptr);
 
     for (auto &file : files)
     {
+        if (file.fileid != -1)
+        {
+            sqlite3_bind_int64(known_stmt, 1, static_cast<sqlite3_int64>(file.size));
+            sqlite3_bind_int64(known_stmt, 2, file.mtime);
+            sqlite3_bind_int64(known_stmt, 3, file.uid);
+            sqlite3_bind_int64(known_stmt, 4, generation);
+            sqlite3_bind_text(known_stmt, 5, file.extension.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int64(known_stmt, 6, file.fileid);
+            sqlite3_bind_text(known_stmt, 7, file.absolute_path.c_str(), -1, SQLITE_TRANSIENT);
+            bool updated = sqlite3_step(known_stmt) == SQLITE_DONE && sqlite3_changes(db) == 1;
+            sqlite3_reset(known_stmt);
+            if (updated)
+                continue;
+            file.fileid = -1;
+        }
+
         sqlite3_bind_text(file_stmt, 1, file.filename.c_str(), -1, SQLITE_TRANSIENT);
         sqlite3_bind_text(file_stmt, 2, file.absolute_path.c_str(), -1, SQLITE_TRANSIENT);
         sqlite3_bind_text(file_stmt, 3, file.extension.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(file_stmt, 4, static_cast<sqlite3_int64>(file.size));
+        sqlite3_bind_int64(file_stmt, 5, file.mtime);
+        sqlite3_bind_int64(file_stmt, 6, file.uid);
+        sqlite3_bind_int64(file_stmt, 7, generation);
 
-        if (sqlite3_step(file_stmt) == SQLITE_DONE)
+        sqlite3_int64 last_rowid = sqlite3_last_insert_rowid(db);
+        if (sqlite3_step(file_stmt) == SQLITE_ROW)
         {
-            int fileid = sqlite3_last_insert_rowid(db);
+            file.fileid = sqlite3_column_int64(file_stmt, 0);
+            while (sqlite3_step(file_stmt) == SQLITE_ROW)
+                ;
+        }
 
-            // Concatenate all tokens into a single string
-            std::string all_tokens;
-            for (const auto &token : file.tokens)
-            {
-                all_tokens += token + " ";
-            }
+        if (file.fileid != -1 && sqlite3_last_insert_rowid(db) != last_rowid)
+        {
+            sqlite3_int64 fileid = file.fileid;
+
+            std::string all_tokens = token_text(file.tokens);
 
             if (!all_tokens.empty())
             {
@@ -227,6 +395,7 @@ void SQLiteWrapper::batch_insert_files(std::vector<FileRecord> &files)
         sqlite3_clear_bindings(file_stmt);
     }
 
+    sqlite3_finalize(known_stmt);
     sqlite3_finalize(file_stmt);
     sqlite3_finalize(token_stmt);
 
@@ -288,44 +457,578 @@ void SQLiteWrapper::batch_insert_files(std::vector<FileRecord> &files)
 // }
 //
 
-std::vector<SQLiteWrapper::FileResult> SQLiteWrapper::search(const std::string &prefix, const short limit, const short offset) const
+// accepted(fileid): the caller's filter, callable from SQL.
+static void accepted_function(sqlite3_context *ctx, int, sqlite3_value **argv)
 {
-    sqlite3 *db = open_db();
-    std::vector<FileResult> results;
-    if (!db)
-        return results;
+    const auto *accept = static_cast<const std::function<bool(int64_t)> *>(sqlite3_user_data(ctx));
+    sqlite3_result_int(ctx, (*accept)(sqlite3_value_int64(argv[0])));
+}
 
-    std::string search_term = prefix + "*";
+// Runs one page of a ranked MATCH. Rows are ordered by (rank, rowid) and
+// the cursor keeps the last one returned, so the next page seeks past it
+// rather than re-reading and discarding an OFFSET's worth of rows.
+//
+// bm25 has to be computed for every match to find the best ones, and that
+// is most of a page's cost (about 25 ms for the 30k files matching "s").
+// FTS5's own ORDER BY rank measured slower still (42 ms against 30) and
+// can't break rank ties by rowid for the cursor. So the ranking is done in
+// a subquery over just (rowid, rank), where LIMIT lets SQLite keep only a
+// page-sized top-N, and only that page is joined to its files. A filter
+// runs inside the subquery as accepted(), ahead of bm25, so the LIMIT
+// counts accepted rows and rejected ones are never ranked at all.
+//
+// Without a cursor there is no next page to keep consistent, and the
+// caller (a keystroke in the client) scores rows itself: the first limit
+// matches are taken in index order and ranked among themselves, which
+// costs bm25 for those rows only (6 ms against 31 for "s").
+//
+// from names the FTS table as f plus whatever joins reach fileid.
+static std::vector<SQLiteWrapper::FileResult> ranked_page(sqlite3 *db, const std::string &table,
+                                                          const std::string &from, const std::string &fileid,
+                                                          const std::string &prefix, short limit,
+                                                          SQLiteWrapper::SearchCursor *cursor,
+                                                          const std::function<bool(int64_t)> &accept)
+{
+    std::vector<SQLiteWrapper::FileResult> results;
+    if (cursor && cursor->exhausted)
+        return results;
 
+    std::string rank = "bm25(" + table + ")";
     std::string q =
-        "SELECT DISTINCT i.filename, i.absolute_path, i.extension "
-        "FROM fts_index f "
-        "JOIN index_table i ON f.rowid = i.fileid "
-        "WHERE fts_index MATCH ? "
-        "LIMIT ? OFFSET ?;";
+        "SELECT i.filename, i.absolute_path, i.extension, i.fileid, p.rank, p.rowid FROM ("
+        "SELECT f.rowid AS rowid, " + fileid + " AS fileid, " + rank + " AS rank FROM " + from +
+        " WHERE " + table + " MATCH ?1";
+    if (accept)
+        q += " AND accepted(" + fileid + ")";
+    if (cursor && cursor->started)
+        q += " AND (" + rank + ", f.rowid) > (?2, ?3)";
+    if (cursor)
+        q += " ORDER BY rank, f.rowid";
+    q += " LIMIT ?4) p LEFT JOIN index_table i ON p.fileid = i.fileid ORDER BY p.rank, p.rowid;";
+
+    if (accept)
+        sqlite3_create_function(db, "accepted", 1, SQLITE_UTF8, const_cast<std::function<bool(int64_t)> *>(&accept),
+                                accepted_function, nullptr, nullptr);
 
     sqlite3_stmt *stmt;
     if (sqlite3_prepare_v2(db, q.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
     {
         std::cerr << "SQL Error: " << sqlite3_errmsg(db) << "\n";
-        close_db(db);
         return results;
     }
 
+    std::string search_term = prefix + "*";
     sqlite3_bind_text(stmt, 1, search_term.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int(stmt, 2, limit);
-    sqlite3_bind_int(stmt, 3, offset);
+    if (cursor && cursor->started)
+    {
+        sqlite3_bind_double(stmt, 2, cursor->rank);
+        sqlite3_bind_int64(stmt, 3, cursor->rowid);
+    }
+    sqlite3_bind_int(stmt, 4, limit);
 
+    // A match whose file row is gone still counts towards the page, so a
+    // short page really is the last one.
+    int rows = 0;
     while (sqlite3_step(stmt) == SQLITE_ROW)
     {
-        FileResult fr;
+        rows++;
+        if (cursor)
+        {
+            cursor->rank = sqlite3_column_double(stmt, 4);
+            cursor->rowid = sqlite3_column_int64(stmt, 5);
+            cursor->started = true;
+        }
+        if (sqlite3_column_type(stmt, 0) == SQLITE_NULL)
+            continue;
+
+        SQLiteWrapper::FileResult fr;
         fr.filename = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
         fr.absolute_path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
         fr.extension = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+        fr.fileid = sqlite3_column_int64(stmt, 3);
+        fr.rank = sqlite3_column_double(stmt, 4);
         results.push_back(fr);
     }
 
+    // A full page may have been the last one; the next call finds out.
+    if (cursor && rows < limit)
+        cursor->exhausted = true;
+
+    sqlite3_finalize(stmt);
+    return results;
+}
+
+// A cursor's pages all read from the connection its first page opened,
+// inside one read transaction.
+sqlite3 *SQLiteWrapper::cursor_db(SearchCursor *cursor) const
+{
+    if (!cursor)
+        return open_db();
+    if (!cursor->connection)
+    {
+        sqlite3 *db = open_db();
+        if (!db)
+            return nullptr;
+        sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+        cursor->connection.reset(db, [](sqlite3 *db)
+        {
+            sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+            sqlite3_close(db);
+        });
+    }
+    return cursor->connection.get();
+}
+
+void SQLiteWrapper::release_db(sqlite3 *db, SearchCursor *cursor) const
+{
+    if (!cursor)
+        close_db(db);
+    else if (cursor->exhausted)
+        cursor->connection.reset();
+}
+
+std::vector<SQLiteWrapper::FileResult> SQLiteWrapper::search(const std::string &prefix, const short limit,
+                                                             SearchCursor *cursor,
+                                                             const std::function<bool(int64_t)> &accept) const
+{
+    sqlite3 *db = cursor_db(cursor);
+    if (!db)
+        return {};
+
+    std::vector<FileResult> results =
+        ranked_page(db, "fts_index", "fts_index f", "f.rowid", prefix, limit, cursor, accept);
+
+    release_db(db, cursor);
+    return results;
+}
+
+std::vector<SQLiteWrapper::FileResult> SQLiteWrapper::search_content(const std::string &prefix, const short limit,
+                                                                     SearchCursor *cursor,
+                                                                     const std::function<bool(int64_t)> &accept) const
+{
+    sqlite3 *db = cursor_db(cursor);
+    if (!db)
+        return {};
+
+    std::vector<FileResult> results = ranked_page(
+        db, "content_fts", "content_fts f JOIN content_docs c ON f.rowid = c.docid", "c.fileid",
+        prefix, limit, cursor, accept);
+
+    release_db(db, cursor);
+    return results;
+}
+
+// Files never read, or modified since they were, in fileid order so the
+// caller can page through with the last id it saw.
+std::vector<SQLiteWrapper::ContentCandidate> SQLiteWrapper::content_candidates(int64_t after_fileid,
+                                                                               size_t limit) const
+{
+    std::vector<ContentCandidate> candidates;
+    sqlite3 *db = open_db();
+    if (!db)
+        return candidates;
+
+    const char *sql =
+        "SELECT i.fileid, i.absolute_path, i.mtime, i.size FROM index_table i "
+        "LEFT JOIN content_docs c ON c.fileid = i.fileid "
+        "WHERE i.fileid > ? AND i.size > 0 AND (c.fileid IS NULL OR c.mtime != i.mtime) "
+        "ORDER BY i.fileid LIMIT ?;";
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK)
+    {
+        sqlite3_bind_int64(stmt, 1, after_fileid);
+        sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(limit));
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            ContentCandidate c;
+            c.fileid = sqlite3_column_int64(stmt, 0);
+            c.absolute_path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            c.mtime = sqlite3_column_int64(stmt, 2);
+            c.size = static_cast<uint64_t>(sqlite3_column_int64(stmt, 3));
+            candidates.push_back(std::move(c));
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    close_db(db);
+    return candidates;
+}
+
+void SQLiteWrapper::batch_insert_content(const std::vector<ContentDocument> &docs)
+{
+    sqlite3 *db = open_db();
+    if (!db)
+        return;
+
+    sqlite3_exec(db, "BEGIN TRANSACTION;", nullptr, nullptr, nullptr);
+
+    sqlite3_stmt *drop_stmt;
+    sqlite3_stmt *doc_stmt;
+    sqlite3_stmt *body_stmt;
+    sqlite3_prepare_v2(db, "DELETE FROM content_docs WHERE fileid = ?;", -1, &drop_stmt, nullptr);
+    sqlite3_prepare_v2(db, "INSERT INTO content_docs (fileid, mtime, is_text) VALUES (?, ?, ?);", -1, &doc_stmt, nullptr);
+    sqlite3_prepare_v2(db, "INSERT INTO content_fts(rowid, body) VALUES (?, ?);", -1, &body_stmt, nullptr);
+
+    for (const auto &doc : docs)
+    {
+        sqlite3_bind_int64(drop_stmt, 1, doc.fileid);
+        sqlite3_step(drop_stmt);
+        sqlite3_reset(drop_stmt);
+
+        sqlite3_bind_int64(doc_stmt, 1, doc.fileid);
+        sqlite3_bind_int64(doc_stmt, 2, doc.mtime);
+        sqlite3_bind_int(doc_stmt, 3, doc.is_text ? 1 : 0);
+        bool inserted = sqlite3_step(doc_stmt) == SQLITE_DONE;
+        sqlite3_reset(doc_stmt);
+
+        if (inserted && doc.is_text && !doc.body.empty())
+        {
+            sqlite3_bind_int64(body_stmt, 1, sqlite3_last_insert_rowid(db));
+            sqlite3_bind_text(body_stmt, 2, doc.body.data(), static_cast<int>(doc.body.size()), SQLITE_STATIC);
+            sqlite3_step(body_stmt);
+            sqlite3_reset(body_stmt);
+        }
+    }
+
+    sqlite3_finalize(drop_stmt);
+    sqlite3_finalize(doc_stmt);
+    sqlite3_finalize(body_stmt);
+
+    sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+    close_db(db);
+}
+
+// Stale documents are docids handed out but no longer referenced, i.e.
+// orphaned FTS postings.
+void SQLiteWrapper::count_content_documents(int64_t &live, int64_t &stale) const
+{
+    live = stale = 0;
+    sqlite3 *db = open_db();
+    if (!db)
+        return;
+
+    const char *sql =
+        "SELECT (SELECT COUNT(*) FROM content_docs), "
+        "COALESCE((SELECT seq FROM sqlite_sequence WHERE name = 'content_docs'), 0);";
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            live = sqlite3_column_int64(stmt, 0);
+            stale = sqlite3_column_int64(stmt, 1) - live;
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    close_db(db);
+}
+
+void SQLiteWrapper::reset_content_index()
+{
+    sqlite3 *db = open_db();
+    if (!db)
+        return;
+
+    sqlite3_exec(db,
+                 "BEGIN TRANSACTION;"
+                 "INSERT INTO content_fts(content_fts) VALUES ('delete-all');"
+                 "DELETE FROM content_docs;"
+                 "DELETE FROM sqlite_sequence WHERE name = 'content_docs';"
+                 "COMMIT;",
+                 nullptr, nullptr, nullptr);
+    close_db(db);
+}
+
+std::vector<SQLiteWrapper::FileResult> SQLiteWrapper::get_files(const std::vector<int64_t> &fileids) const
+{
+    std::vector<FileResult> results;
+    if (fileids.empty())
+        return results;
+
+    sqlite3 *db = open_db();
+    if (!db)
+        return results;
+
+    const char *sql =
+        "SELECT filename, absolute_path, extension FROM index_table WHERE fileid = ?;";
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+    {
+        close_db(db);
+        return results;
+    }
+
+    for (int64_t fileid : fileids)
+    {
+        sqlite3_bind_int64(stmt, 1, fileid);
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            FileResult fr;
+            fr.filename = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            fr.absolute_path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            fr.extension = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+            fr.fileid = fileid;
+            results.push_back(fr);
+        }
+        sqlite3_reset(stmt);
+    }
+
     sqlite3_finalize(stmt);
     close_db(db);
     return results;
-}
\ No newline at end of file
+}
+
+void SQLiteWrapper::scan_paths(const std::function<void(int64_t fileid, const char *path)> &visit) const
+{
+    sqlite3 *db = open_db();
+    if (!db)
+        return;
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT fileid, absolute_path FROM index_table;", -1, &stmt, nullptr) == SQLITE_OK)
+    {
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+            visit(sqlite3_column_int64(stmt, 0), reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)));
+        sqlite3_finalize(stmt);
+    }
+
+    close_db(db);
+}
+
+std::string SQLiteWrapper::database_id() const
+{
+    sqlite3 *db = open_db();
+    if (!db)
+        return "";
+
+    std::string id;
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT value FROM meta WHERE key = 'database_id';", -1, &stmt, nullptr) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            id = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+        sqlite3_finalize(stmt);
+    }
+
+    close_db(db);
+    return id;
+}
+
+int64_t SQLiteWrapper::max_generation() const
+{
+    sqlite3 *db = open_db();
+    if (!db)
+        return 0;
+
+    int64_t generation = 0;
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT COALESCE(MAX(generation), 0) FROM index_table;", -1, &stmt, nullptr) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            generation = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+
+    close_db(db);
+    return generation;
+}
+
+// A null generation visits every row.
+static void scan_rows(const SQLiteWrapper &wrapper, const int64_t *generation,
+                      const std::function<void(const SQLiteWrapper::FileResult &)> &visit)
+{
+    sqlite3 *db = wrapper.open_db();
+    if (!db)
+        return;
+
+    const char *sql =
+        "SELECT filename, absolute_path, extension, fileid FROM index_table WHERE ?1 IS NULL OR generation = ?1;";
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK)
+    {
+        if (generation)
+            sqlite3_bind_int64(stmt, 1, *generation);
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            SQLiteWrapper::FileResult fr;
+            fr.filename = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            fr.absolute_path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            const unsigned char *ext = sqlite3_column_text(stmt, 2);
+            fr.extension = ext ? reinterpret_cast<const char*>(ext) : "";
+            fr.fileid = sqlite3_column_int64(stmt, 3);
+            visit(fr);
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    wrapper.close_db(db);
+}
+
+void SQLiteWrapper::scan_generation(int64_t generation, const std::function<void(const FileResult &)> &visit) const
+{
+    scan_rows(*this, &generation, visit);
+}
+
+void SQLiteWrapper::scan_files(const std::function<void(const FileResult &)> &visit) const
+{
+    scan_rows(*this, nullptr, visit);
+}
+
+// The scope is a directory: rows at or below it are swept, rows elsewhere
+// belong to crawls of other directories and keep whatever generation they
+// have. Each stale row's tokens are deleted from the FTS index before the
+// rows themselves go in a single DELETE. A content_docs row is dropped
+// like a changed file's, its postings left for reset_content_index().
+void SQLiteWrapper::scan_scope(const std::string &scope, const std::function<void(int64_t fileid)> &visit) const
+{
+    sqlite3 *db = open_db();
+    if (!db)
+        return;
+
+    std::string dir = scope;
+    while (!dir.empty() && dir.back() == '/')
+        dir.pop_back();
+    // Paths below dir sort between "dir/" and "dir0", '0' following '/'.
+    std::string below_lo = dir + "/";
+    std::string below_hi = dir + "0";
+    const char *sql =
+        "SELECT fileid FROM index_table WHERE absolute_path = ?1 OR (absolute_path >= ?2 AND absolute_path < ?3);";
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK)
+    {
+        sqlite3_bind_text(stmt, 1, dir.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 2, below_lo.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 3, below_hi.c_str(), -1, SQLITE_TRANSIENT);
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+            visit(sqlite3_column_int64(stmt, 0));
+        sqlite3_finalize(stmt);
+    }
+
+    close_db(db);
+}
+
+size_t SQLiteWrapper::sweep_generation(int64_t generation, const std::string &scope,
+                                       const std::function<void(const FileResult &)> &visit)
+{
+    sqlite3 *db = open_db();
+    if (!db)
+        return 0;
+
+    std::string dir = scope;
+    while (!dir.empty() && dir.back() == '/')
+        dir.pop_back();
+    // Paths below dir sort between "dir/" and "dir0", '0' following '/'.
+    std::string below_lo = dir + "/";
+    std::string below_hi = dir + "0";
+    const char *where =
+        " WHERE generation < ?1 AND (absolute_path = ?2 OR (absolute_path >= ?3 AND absolute_path < ?4))";
+
+    auto bind_scope = [&](sqlite3_stmt *stmt)
+    {
+        sqlite3_bind_int64(stmt, 1, generation);
+        sqlite3_bind_text(stmt, 2, dir.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 3, below_lo.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 4, below_hi.c_str(), -1, SQLITE_TRANSIENT);
+    };
+
+    sqlite3_exec(db, "BEGIN TRANSACTION;", nullptr, nullptr, nullptr);
+
+    std::string select_sql = std::string("SELECT filename, absolute_path, extension, fileid FROM index_table") + where + ";";
+    std::string content_sql = std::string("DELETE FROM content_docs WHERE fileid IN (SELECT fileid FROM index_table") + where + ");";
+    std::string delete_sql = std::string("DELETE FROM index_table") + where + ";";
+    const char *token_sql = "INSERT INTO fts_index(fts_index, rowid, tokens) VALUES ('delete', ?, ?);";
+
+    sqlite3_stmt *select_stmt;
+    sqlite3_stmt *token_stmt;
+    if (sqlite3_prepare_v2(db, select_sql.c_str(), -1, &select_stmt, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, token_sql, -1, &token_stmt, nullptr) != SQLITE_OK)
+    {
+        std::cerr << "SQL Error: " << sqlite3_errmsg(db) << "\n";
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        close_db(db);
+        return 0;
+    }
+
+    size_t removed = 0;
+    bind_scope(select_stmt);
+    while (sqlite3_step(select_stmt) == SQLITE_ROW)
+    {
+        FileResult fr;
+        fr.filename = reinterpret_cast<const char*>(sqlite3_column_text(select_stmt, 0));
+        fr.absolute_path = reinterpret_cast<const char*>(sqlite3_column_text(select_stmt, 1));
+        const unsigned char *ext = sqlite3_column_text(select_stmt, 2);
+        fr.extension = ext ? reinterpret_cast<const char*>(ext) : "";
+        fr.fileid = sqlite3_column_int64(select_stmt, 3);
+
+        std::string all_tokens = token_text(tokenize(fr.absolute_path));
+        if (!all_tokens.empty())
+        {
+            sqlite3_bind_int64(token_stmt, 1, fr.fileid);
+            sqlite3_bind_text(token_stmt, 2, all_tokens.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_step(token_stmt);
+            sqlite3_reset(token_stmt);
+        }
+
+        visit(fr);
+        removed++;
+    }
+    sqlite3_finalize(select_stmt);
+    sqlite3_finalize(token_stmt);
+
+    for (const std::string *sql : {&content_sql, &delete_sql})
+    {
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db, sql->c_str(), -1, &stmt, nullptr) == SQLITE_OK)
+        {
+            bind_scope(stmt);
+            sqlite3_step(stmt);
+            sqlite3_finalize(stmt);
+        }
+    }
+
+    sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+
+    // Deletes are only tombstones in the FTS segments until they are merged;
+    // after a large sweep, merge everything so the index shrinks now, and
+    // hand the freed pages back (databases created before auto_vacuum was
+    // set keep them on the freelist for reuse instead).
+    if (removed >= OPTIMIZE_AFTER_REMOVED)
+    {
+        sqlite3_exec(db, "INSERT INTO fts_index(fts_index) VALUES ('optimize');", nullptr, nullptr, nullptr);
+        sqlite3_exec(db, "PRAGMA incremental_vacuum;", nullptr, nullptr, nullptr);
+    }
+
+    close_db(db);
+    return removed;
+}
+
+void SQLiteWrapper::scan_metadata(const std::function<void(int64_t, uint64_t, int64_t, const char *)> &visit) const
+{
+    sqlite3 *db = open_db();
+    if (!db)
+        return;
+
+    const char *sql = "SELECT fileid, size, mtime, extension FROM index_table;";
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK)
+    {
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            const unsigned char *ext = sqlite3_column_text(stmt, 3);
+            visit(sqlite3_column_int64(stmt, 0),
+                  static_cast<uint64_t>(sqlite3_column_int64(stmt, 1)),
+                  sqlite3_column_int64(stmt, 2),
+                  ext ? reinterpret_cast<const char*>(ext) : "");
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    close_db(db);
+}
@@ -0,0 +1,337 @@
+#include "statx_batch.h"
+#include "file_crawler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace
+{
+int io_uring_setup(unsigned entries, io_uring_params *p)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+int io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+constexpr unsigned STATX_FIELDS = STATX_SIZE | STATX_MTIME | STATX_UID;
+
+void fill_metadata(FileRecord &rec, const struct statx &stx)
+{
+    rec.size = stx.stx_size;
+    rec.mtime = stx.stx_mtime.tv_sec;
+    rec.uid = stx.stx_uid;
+    rec.has_metadata = true;
+}
+}
+
+StatxBatcher::StatxBatcher(unsigned entries)
+{
+    if (setup(entries) && !supports_statx())
+    {
+        teardown();
+    }
+}
+
+StatxBatcher::~StatxBatcher()
+{
+    wait();
+    teardown();
+}
+
+bool StatxBatcher::uses_io_uring() const
+{
+    return ring_fd >= 0;
+}
+
+bool StatxBatcher::setup(unsigned entries)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ring_fd = io_uring_setup(entries, &params);
+    if (ring_fd < 0)
+    {
+        ring_fd = -1;
+        return false;
+    }
+    ring_entries = params.sq_entries;
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED)
+    {
+        sq_ring = nullptr;
+        teardown();
+        return false;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        cq_ring = sq_ring;
+    }
+    else
+    {
+        cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED)
+        {
+            cq_ring = nullptr;
+            teardown();
+            return false;
+        }
+    }
+
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqe_mem = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring_fd, IORING_OFF_SQES);
+    if (sqe_mem == MAP_FAILED)
+    {
+        teardown();
+        return false;
+    }
+    sqes = static_cast<io_uring_sqe *>(sqe_mem);
+
+    char *sq = static_cast<char *>(sq_ring);
+    sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+
+    char *cq = static_cast<char *>(cq_ring);
+    cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    return true;
+}
+
+// IORING_OP_STATX exists since 5.6; older rings accept setup but reject it.
+bool StatxBatcher::supports_statx()
+{
+    size_t len = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+    std::vector<char> buf(len, 0);
+    auto *probe = reinterpret_cast<io_uring_probe *>(buf.data());
+
+    if (io_uring_register(ring_fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+    {
+        return false;
+    }
+    if (probe->last_op < IORING_OP_STATX)
+    {
+        return false;
+    }
+    return probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED;
+}
+
+void StatxBatcher::teardown()
+{
+    if (sqes)
+    {
+        munmap(sqes, sqes_size);
+        sqes = nullptr;
+    }
+    if (cq_ring && cq_ring != sq_ring)
+    {
+        munmap(cq_ring, cq_ring_size);
+    }
+    cq_ring = nullptr;
+    if (sq_ring)
+    {
+        munmap(sq_ring, sq_ring_size);
+        sq_ring = nullptr;
+    }
+    if (ring_fd >= 0)
+    {
+        close(ring_fd);
+        ring_fd = -1;
+    }
+}
+
+void StatxBatcher::stat_all(std::vector<FileRecord> &files)
+{
+    submit(files);
+    wait();
+}
+
+void StatxBatcher::submit(std::vector<FileRecord> &files)
+{
+    wait();
+    if (!uses_io_uring())
+    {
+        stat_serial(files, 0, files.size());
+        return;
+    }
+
+    // Anything beyond the ring size is resolved inline rather than waiting
+    // for ring space.
+    unsigned count = static_cast<unsigned>(std::min<size_t>(files.size(), ring_entries));
+    results.resize(count);
+
+    unsigned tail = *sq_tail;
+    for (unsigned i = 0; i < count; i++)
+    {
+        unsigned idx = (tail + i) & *sq_mask;
+        io_uring_sqe *sqe = &sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<unsigned long>(files[i].absolute_path.c_str());
+        sqe->len = STATX_FIELDS;
+        sqe->off = reinterpret_cast<unsigned long>(&results[i]);
+        sqe->statx_flags = AT_STATX_DONT_SYNC;
+        sqe->user_data = i;
+        sq_array[idx] = idx;
+    }
+    __atomic_store_n(sq_tail, tail + count, __ATOMIC_RELEASE);
+
+    in_flight = &files;
+    submitted = 0;
+    completed = 0;
+    while (submitted < count)
+    {
+        int rc = io_uring_enter(ring_fd, count - submitted, 0, 0);
+        if (rc < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+            {
+                reap();
+                continue;
+            }
+            // The ring is unusable; finish this and every later batch serially.
+            std::cerr << "io_uring_enter failed: " << strerror(errno) << ", falling back to statx()\n";
+            abandon_ring(files, count);
+            stat_serial(files, count, files.size());
+            return;
+        }
+        submitted += static_cast<unsigned>(rc);
+    }
+
+    stat_serial(files, count, files.size());
+}
+
+void StatxBatcher::wait()
+{
+    if (!in_flight)
+    {
+        return;
+    }
+
+    while (completed < submitted)
+    {
+        int rc = io_uring_enter(ring_fd, 0, submitted - completed, IORING_ENTER_GETEVENTS);
+        if (rc < 0 && errno != EINTR)
+        {
+            std::cerr << "io_uring_enter failed: " << strerror(errno) << ", falling back to statx()\n";
+            abandon_ring(*in_flight, results.size());
+            return;
+        }
+        reap();
+    }
+    in_flight = nullptr;
+}
+
+// Requests still in flight can't be waited for, so the ring is dropped
+// along with the buffer they write into, and the first count records are
+// finished with plain statx unless their completion was already reaped.
+// Every later batch goes serial.
+void StatxBatcher::abandon_ring(std::vector<FileRecord> &files, size_t count)
+{
+    abandoned.push_back(std::move(results));
+    results = std::vector<struct statx>();
+    in_flight = nullptr;
+    teardown();
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!files[i].has_metadata)
+        {
+            stat_serial(files, i, i + 1);
+        }
+    }
+}
+
+void StatxBatcher::reap()
+{
+    unsigned head = *cq_head;
+    unsigned end = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != end; head++)
+    {
+        io_uring_cqe *cqe = &cqes[head & *cq_mask];
+        if (cqe->res == 0)
+        {
+            fill_metadata((*in_flight)[cqe->user_data], results[cqe->user_data]);
+        }
+        completed++;
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+}
+
+void StatxBatcher::stat_serial(std::vector<FileRecord> &files, size_t begin, size_t end)
+{
+    struct statx stx;
+    for (size_t i = begin; i < end; i++)
+    {
+        if (statx(AT_FDCWD, files[i].absolute_path.c_str(), AT_STATX_DONT_SYNC, STATX_FIELDS, &stx) == 0)
+        {
+            fill_metadata(files[i], stx);
+        }
+    }
+}
+
+#else
+
+StatxBatcher::StatxBatcher(unsigned entries) {}
+
+StatxBatcher::~StatxBatcher() {}
+
+bool StatxBatcher::uses_io_uring() const
+{
+    return false;
+}
+
+void StatxBatcher::wait() {}
+
+void StatxBatcher::stat_all(std::vector<FileRecord> &files)
+{
+    submit(files);
+}
+
+void StatxBatcher::submit(std::vector<FileRecord> &files)
+{
+    struct stat st;
+    for (auto &rec : files)
+    {
+        if (stat(rec.absolute_path.c_str(), &st) == 0)
+        {
+            rec.size = st.st_size;
+            rec.mtime = st.st_mtime;
+            rec.uid = st.st_uid;
+            rec.has_metadata = true;
+        }
+    }
+}
+
+#endif
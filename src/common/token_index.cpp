@@ -0,0 +1,492 @@
+#include "token_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static const char TOKEN_INDEX_MAGIC[8] = {'S', 'P', 'T', 'O', 'K', '\0', '\0', '\0'};
+static const uint32_t TOKEN_INDEX_VERSION = 1;
+
+// bm25 parameters, as FTS5 uses them.
+static const double BM25_K1 = 1.2;
+static const double BM25_B = 0.75;
+
+static void put_varint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static uint32_t get_varint(const uint8_t*& in) {
+    uint32_t value = *in & 0x7f;
+    for (int shift = 7; *in++ & 0x80; shift += 7) {
+        value |= static_cast<uint32_t>(*in & 0x7f) << shift;
+    }
+    return value;
+}
+
+// Walks one posting list in ascending order. Stored lists are decoded a
+// block at a time; a prefix matching several tokens is merged up front and
+// walked from memory.
+class TokenIndex::Cursor {
+private:
+    const TokenIndex* index = nullptr;
+    const Term* term = nullptr;
+    uint32_t block = 0;
+    uint32_t block_count = 0;
+    uint64_t count = 0;
+    std::vector<uint32_t> buffer;
+    size_t pos = 0;
+
+    void load_block(uint32_t b) {
+        block = b;
+        index->decode_block(*term, b, buffer);
+        pos = 0;
+    }
+
+public:
+    Cursor(const TokenIndex& index, const Term& term)
+        : index(&index), term(&term), block_count((term.count + BLOCK_SIZE - 1) / BLOCK_SIZE), count(term.count) {
+        load_block(0);
+    }
+
+    explicit Cursor(std::vector<uint32_t> ids) : block_count(1), count(ids.size()), buffer(std::move(ids)) {}
+
+    uint64_t size() const { return count; }
+    bool done() const { return pos >= buffer.size(); }
+    uint32_t value() const { return buffer[pos]; }
+
+    void next() {
+        if (++pos >= buffer.size() && block + 1 < block_count) {
+            load_block(block + 1);
+        }
+    }
+
+    // Moves to the first id >= target: gallops over the block bounds to the
+    // one block that can hold it, then within that block.
+    void seek(uint32_t target) {
+        if (done() || buffer[pos] >= target) {
+            return;
+        }
+        if (buffer.back() < target) {
+            if (!term) {
+                pos = buffer.size();
+                return;
+            }
+            const Block* bounds = &index->blocks[term->first_block];
+            uint32_t lo = block + 1;
+            uint32_t hi = lo;
+            uint32_t step = 1;
+            while (hi < block_count && bounds[hi].last < target) {
+                lo = hi + 1;
+                hi += step;
+                step <<= 1;
+            }
+            hi = std::min(hi, block_count);
+            while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+                if (bounds[mid].last < target) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            if (lo >= block_count) {
+                block = block_count - 1;
+                pos = buffer.size();
+                return;
+            }
+            load_block(lo);
+        }
+
+        size_t lo = pos;
+        size_t hi = pos + 1;
+        size_t step = 1;
+        while (hi < buffer.size() && buffer[hi] < target) {
+            lo = hi;
+            hi += step;
+            step <<= 1;
+        }
+        hi = std::min(hi, buffer.size());
+        pos = std::lower_bound(buffer.begin() + lo, buffer.begin() + hi, target) - buffer.begin();
+    }
+};
+
+uint32_t TokenIndex::block_size(const Term& term, uint32_t block) const {
+    return std::min<uint32_t>(BLOCK_SIZE, term.count - block * BLOCK_SIZE);
+}
+
+void TokenIndex::decode_block(const Term& term, uint32_t block, std::vector<uint32_t>& out) const {
+    const Block& b = blocks[term.first_block + block];
+    uint32_t n = block_size(term, block);
+    out.resize(n);
+    const uint8_t* in = bytes.data() + b.offset;
+    uint32_t id = b.first;
+    out[0] = id;
+    for (uint32_t i = 1; i < n; i++) {
+        id += get_varint(in);
+        out[i] = id;
+    }
+}
+
+void TokenIndex::decode(const Term& term, std::vector<uint32_t>& out) const {
+    out.clear();
+    out.reserve(term.count);
+    std::vector<uint32_t> chunk;
+    for (uint32_t b = 0; b * BLOCK_SIZE < term.count; b++) {
+        decode_block(term, b, chunk);
+        out.insert(out.end(), chunk.begin(), chunk.end());
+    }
+}
+
+void TokenIndex::append_term(const std::string& token, const std::vector<uint32_t>& ids) {
+    terms.push_back({token, static_cast<uint32_t>(ids.size()), static_cast<uint32_t>(blocks.size())});
+    for (size_t i = 0; i < ids.size(); i += BLOCK_SIZE) {
+        size_t end = std::min(ids.size(), i + BLOCK_SIZE);
+        blocks.push_back({ids[i], ids[end - 1], static_cast<uint32_t>(bytes.size())});
+        for (size_t j = i + 1; j < end; j++) {
+            put_varint(bytes, ids[j] - ids[j - 1]);
+        }
+    }
+}
+
+// The union of terms [begin, end), gathered in a bitmap over all fileids
+// so no sorting or k-way merge is needed however many tokens share it.
+std::vector<uint32_t> TokenIndex::expand(size_t begin, size_t end) const {
+    std::vector<uint64_t> bits((lengths.size() + 63) / 64, 0);
+    std::vector<uint32_t> chunk;
+    for (size_t t = begin; t < end; t++) {
+        for (uint32_t b = 0; b * BLOCK_SIZE < terms[t].count; b++) {
+            decode_block(terms[t], b, chunk);
+            for (uint32_t id : chunk) {
+                if (id >= lengths.size()) {
+                    continue;
+                }
+                bits[id >> 6] |= uint64_t(1) << (id & 63);
+            }
+        }
+    }
+
+    std::vector<uint32_t> ids;
+    for (size_t w = 0; w < bits.size(); w++) {
+        uint64_t word = bits[w];
+        while (word) {
+            ids.push_back(static_cast<uint32_t>(w * 64 + __builtin_ctzll(word)));
+            word &= word - 1;
+        }
+    }
+    return ids;
+}
+
+void TokenIndex::recount() {
+    documents = 0;
+    uint64_t total = 0;
+    for (uint8_t length : lengths) {
+        if (length) {
+            documents++;
+            total += length;
+        }
+    }
+    average_length = documents ? static_cast<double>(total) / documents : 0.0;
+}
+
+void TokenIndex::add(const std::unordered_set<std::string>& tokens, int64_t fileid) {
+    if (fileid < 0 || fileid > UINT32_MAX || tokens.empty()) {
+        return;
+    }
+    uint32_t id = static_cast<uint32_t>(fileid);
+    if (id < lengths.size() && lengths[id] != 0) {
+        return;
+    }
+    if (id >= lengths.size()) {
+        lengths.resize(id + 1, 0);
+    }
+    lengths[id] = static_cast<uint8_t>(std::min<size_t>(tokens.size(), 255));
+    for (const auto& token : tokens) {
+        pending[token].push_back(id);
+    }
+}
+
+// Fileids are never reused, so a removed id only has to be dropped from
+// whichever lists hold it at the next compaction.
+void TokenIndex::remove(int64_t fileid) {
+    if (fileid < 0 || static_cast<uint64_t>(fileid) >= lengths.size() || lengths[fileid] == 0) {
+        return;
+    }
+    lengths[fileid] = 0;
+    removed.insert(static_cast<uint32_t>(fileid));
+}
+
+void TokenIndex::clear() {
+    terms.clear();
+    blocks.clear();
+    bytes.clear();
+    lengths.clear();
+    pending.clear();
+    removed.clear();
+    documents = 0;
+    average_length = 0.0;
+}
+
+// Rewrites every list in token order, merging in pending ids and dropping
+// removed ones; lists nothing touched are re-encoded unchanged.
+void TokenIndex::compact() {
+    if (pending.empty() && removed.empty()) {
+        return;
+    }
+
+    std::vector<std::string> added;
+    added.reserve(pending.size());
+    for (const auto& [token, ids] : pending) {
+        added.push_back(token);
+    }
+    std::sort(added.begin(), added.end());
+
+    std::vector<Term> old_terms = std::move(terms);
+    std::vector<Block> old_blocks = std::move(blocks);
+    std::vector<uint8_t> old_bytes = std::move(bytes);
+    terms.clear();
+    blocks.clear();
+    bytes.clear();
+
+    // decode() reads from the members, so old lists are decoded through a
+    // view of the previous arrays.
+    TokenIndex previous;
+    previous.blocks = std::move(old_blocks);
+    previous.bytes = std::move(old_bytes);
+
+    std::vector<uint32_t> ids;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < old_terms.size() || j < added.size()) {
+        bool from_old = i < old_terms.size() && (j >= added.size() || old_terms[i].token <= added[j]);
+        bool from_new = j < added.size() && (i >= old_terms.size() || added[j] <= old_terms[i].token);
+        const std::string& token = from_old ? old_terms[i].token : added[j];
+
+        ids.clear();
+        if (from_old) {
+            previous.decode(old_terms[i++], ids);
+        }
+        if (from_new) {
+            const std::vector<uint32_t>& extra = pending[added[j++]];
+            ids.insert(ids.end(), extra.begin(), extra.end());
+            std::sort(ids.begin(), ids.end());
+            ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        }
+        if (!removed.empty()) {
+            ids.erase(std::remove_if(ids.begin(), ids.end(), [this](uint32_t id) { return removed.count(id) != 0; }),
+                      ids.end());
+        }
+        if (!ids.empty()) {
+            append_term(token, ids);
+        }
+    }
+
+    pending.clear();
+    removed.clear();
+    recount();
+}
+
+bool TokenIndex::empty() const {
+    return terms.empty();
+}
+
+uint64_t TokenIndex::size() const {
+    return documents;
+}
+
+// The dictionary is sorted, so a prefix repeats only in adjacent terms.
+std::vector<std::string> TokenIndex::prefixes(size_t max_length) const {
+    std::vector<std::string> out;
+    std::vector<std::string> last(max_length + 1);
+    for (const auto& term : terms) {
+        for (size_t len = 1; len <= max_length && len <= term.token.size(); len++) {
+            if (last[len].size() != len || term.token.compare(0, len, last[len]) != 0) {
+                last[len] = term.token.substr(0, len);
+                out.push_back(last[len]);
+            }
+        }
+    }
+    return out;
+}
+
+// Each prefix becomes one cursor, and the cursors are intersected by
+// leapfrogging: the rarest leads and every other one seeks to its current
+// id, any overshoot becoming the next target. Matches are scored with bm25
+// over path tokens, each file holding each token once.
+std::vector<TokenIndex::Match> TokenIndex::search(const std::vector<std::string>& prefixes, size_t limit,
+                                                  const std::function<bool(int64_t)>& accept) const {
+    std::vector<Match> top;
+    if (prefixes.empty() || limit == 0 || terms.empty()) {
+        return top;
+    }
+
+    std::vector<Cursor> cursors;
+    for (const auto& prefix : prefixes) {
+        auto first = std::lower_bound(terms.begin(), terms.end(), prefix,
+                                      [](const Term& t, const std::string& p) { return t.token < p; });
+        auto last = first;
+        while (last != terms.end() && last->token.compare(0, prefix.size(), prefix) == 0) {
+            ++last;
+        }
+        if (first == last) {
+            return top;
+        }
+        if (last - first == 1) {
+            cursors.emplace_back(*this, *first);
+        } else {
+            cursors.emplace_back(expand(first - terms.begin(), last - terms.begin()));
+        }
+    }
+    std::sort(cursors.begin(), cursors.end(), [](const Cursor& a, const Cursor& b) { return a.size() < b.size(); });
+
+    double idf = 0.0;
+    for (const auto& cursor : cursors) {
+        double df = static_cast<double>(cursor.size());
+        idf += std::max(1e-6, std::log((documents - df + 0.5) / (df + 0.5)));
+    }
+
+    auto better = [](const Match& a, const Match& b) {
+        return a.rank < b.rank || (a.rank == b.rank && a.fileid < b.fileid);
+    };
+    auto consider = [&](uint32_t id) {
+        if (id >= lengths.size() || lengths[id] == 0 || (accept && !accept(id))) {
+            return;
+        }
+        double norm = 1.0 - BM25_B + BM25_B * lengths[id] / average_length;
+        double rank = -idf * (BM25_K1 + 1.0) / (1.0 + BM25_K1 * norm);
+        if (top.size() == limit && !better({id, rank}, top.front())) {
+            return;
+        }
+        top.push_back({id, rank});
+        std::push_heap(top.begin(), top.end(), better);
+        if (top.size() > limit) {
+            std::pop_heap(top.begin(), top.end(), better);
+            top.pop_back();
+        }
+    };
+
+    Cursor& lead = cursors[0];
+    while (!lead.done()) {
+        uint32_t id = lead.value();
+        bool all = true;
+        for (size_t k = 1; k < cursors.size(); k++) {
+            cursors[k].seek(id);
+            if (cursors[k].done()) {
+                std::sort_heap(top.begin(), top.end(), better);
+                return top;
+            }
+            if (cursors[k].value() != id) {
+                lead.seek(cursors[k].value());
+                all = false;
+                break;
+            }
+        }
+        if (all) {
+            consider(id);
+            lead.next();
+        }
+    }
+
+    std::sort_heap(top.begin(), top.end(), better);
+    return top;
+}
+
+template <typename T>
+static void write_vector(std::ofstream& out, const std::vector<T>& v) {
+    uint64_t n = v.size();
+    out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+    out.write(reinterpret_cast<const char*>(v.data()), n * sizeof(T));
+}
+
+template <typename T>
+static bool read_vector(std::ifstream& in, std::vector<T>& v) {
+    uint64_t n = 0;
+    in.read(reinterpret_cast<char*>(&n), sizeof(n));
+    if (!in || n > (uint64_t(1) << 40) / sizeof(T)) {
+        return false;
+    }
+    v.resize(n);
+    in.read(reinterpret_cast<char*>(v.data()), n * sizeof(T));
+    return static_cast<bool>(in);
+}
+
+void TokenIndex::save(const std::string& filename) {
+    compact();
+
+    std::ofstream out(filename, std::ios::binary);
+    if (!out) {
+        std::cerr << "Error opening file for writing: " << filename << std::endl;
+        return;
+    }
+
+    out.write(TOKEN_INDEX_MAGIC, sizeof(TOKEN_INDEX_MAGIC));
+    out.write(reinterpret_cast<const char*>(&TOKEN_INDEX_VERSION), sizeof(TOKEN_INDEX_VERSION));
+    uint64_t count = terms.size();
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (const auto& term : terms) {
+        uint32_t len = static_cast<uint32_t>(term.token.size());
+        out.write(reinterpret_cast<const char*>(&len), sizeof(len));
+        out.write(term.token.data(), len);
+        out.write(reinterpret_cast<const char*>(&term.count), sizeof(term.count));
+        out.write(reinterpret_cast<const char*>(&term.first_block), sizeof(term.first_block));
+    }
+    write_vector(out, blocks);
+    write_vector(out, bytes);
+    write_vector(out, lengths);
+}
+
+bool TokenIndex::load(const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) {
+        std::cerr << "Error opening file for reading: " << filename << std::endl;
+        return false;
+    }
+
+    char magic[sizeof(TOKEN_INDEX_MAGIC)];
+    uint32_t version = 0;
+    uint64_t count = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (!in || std::memcmp(magic, TOKEN_INDEX_MAGIC, sizeof(magic)) != 0 || version != TOKEN_INDEX_VERSION) {
+        std::cerr << "Unsupported token index format in " << filename << std::endl;
+        return false;
+    }
+
+    TokenIndex loaded;
+    loaded.terms.reserve(count);
+    for (uint64_t i = 0; i < count && in; i++) {
+        uint32_t len = 0;
+        in.read(reinterpret_cast<char*>(&len), sizeof(len));
+        Term term;
+        term.token.resize(len);
+        in.read(&term.token[0], len);
+        in.read(reinterpret_cast<char*>(&term.count), sizeof(term.count));
+        in.read(reinterpret_cast<char*>(&term.first_block), sizeof(term.first_block));
+        loaded.terms.push_back(std::move(term));
+    }
+    if (!in || !read_vector(in, loaded.blocks) || !read_vector(in, loaded.bytes) || !read_vector(in, loaded.lengths)) {
+        std::cerr << "Truncated token index " << filename << std::endl;
+        return false;
+    }
+
+    // A corrupt file must not send a cursor outside the arrays.
+    for (const auto& term : loaded.terms) {
+        uint64_t block_count = (static_cast<uint64_t>(term.count) + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        if (term.count == 0 || term.first_block + block_count > loaded.blocks.size() ||
+            loaded.blocks[term.first_block].offset > loaded.bytes.size() ||
+            loaded.blocks[term.first_block + block_count - 1].last >= loaded.lengths.size()) {
+            std::cerr << "Corrupt token index " << filename << std::endl;
+            return false;
+        }
+    }
+
+    *this = std::move(loaded);
+    recount();
+    return true;
+}
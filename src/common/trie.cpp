@@ -1,13 +1,22 @@
 #include "trie.h"
 #include <queue>
+#include <cctype>
+#include <cstring>
+#include <algorithm>
+#include <cstdio>
 
-void write_string(std::ofstream& out, const std::string& s) {
+// Bumped whenever the on-disk node layout changes; older files are ignored
+// until the indexer saves a fresh snapshot.
+static const char TRIE_MAGIC[8] = {'S', 'P', 'T', 'R', 'I', 'E', '\0', '\0'};
+static const uint32_t TRIE_VERSION = 2;
+
+void write_string(std::ostream& out, const std::string& s) {
     size_t len = s.length();
     out.write(reinterpret_cast<const char*>(&len), sizeof(len));
     out.write(s.c_str(), len);
 }
 
-std::string read_string(std::ifstream& in) {
+std::string read_string(std::istream& in) {
     size_t len;
     in.read(reinterpret_cast<char*>(&len), sizeof(len));
     std::string s(len, '\0');
@@ -15,6 +24,13 @@ std::string read_string(std::ifstream& in) {
     return s;
 }
 
+// Trie keys are lowercased bytes. tolower() is only defined for unsigned
+// char values; handing it the negative chars of a UTF-8 name is undefined,
+// and in optimised builds made removal miss the child it had just deleted.
+static char fold_case(char c) {
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+}
+
 TrieNode::TrieNode() : is_leaf(false) {}
 
 TrieNode::~TrieNode() {
@@ -31,12 +47,56 @@ void TrieNode::set_leaf(bool leaf) {
     is_leaf = leaf;
 }
 
-void TrieNode::set_file_info(const FileInfo& info) {
-    file_info = info;
+static void replace_file(FileInfo& existing, const FileInfo& info, bool* changed) {
+    if (changed && (existing.filename != info.filename || existing.extension != info.extension ||
+                    existing.fileid != info.fileid)) {
+        *changed = true;
+    }
+    existing = info;
 }
 
-FileInfo TrieNode::get_file_info() {
-    return file_info;
+bool TrieNode::add_file_info(const FileInfo& info, bool* changed) {
+    if (files.size() < INDEXED_LEAF) {
+        for (auto& existing : files) {
+            if (existing.absolute_path == info.absolute_path) {
+                replace_file(existing, info, changed);
+                return false;
+            }
+        }
+        files.push_back(info);
+        if (changed) *changed = true;
+        return true;
+    }
+
+    std::hash<std::string> hash;
+    if (!path_slots) {
+        path_slots = std::make_unique<std::unordered_multimap<size_t, size_t>>();
+        path_slots->reserve(files.size() * 2);
+        for (size_t i = 0; i < files.size(); i++) {
+            path_slots->emplace(hash(files[i].absolute_path), i);
+        }
+    }
+    size_t h = hash(info.absolute_path);
+    auto range = path_slots->equal_range(h);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (files[it->second].absolute_path == info.absolute_path) {
+            replace_file(files[it->second], info, changed);
+            return false;
+        }
+    }
+    path_slots->emplace(h, files.size());
+    files.push_back(info);
+    if (changed) *changed = true;
+    return true;
+}
+
+const std::vector<FileInfo>& TrieNode::get_files() const {
+    return files;
+}
+
+std::vector<FileInfo>& TrieNode::edit_files() {
+    path_slots.reset();
+    return files;
 }
 
 bool TrieNode::has_child(char c) {
@@ -69,75 +129,206 @@ TrieSearch::~TrieSearch() {
     delete root;
 }
 
-void TrieSearch::insert(const std::string& filename, const std::string& absolute_path, const std::string& extension) {
+// Rough per-node footprint: the node itself, one hash map entry per child
+// and the heap part of every stored string.
+size_t TrieSearch::node_bytes(TrieNode* node) {
+    size_t bytes = sizeof(TrieNode) + node->get_children().size() * (sizeof(void*) * 4);
+    for (const auto& info : node->get_files()) {
+        bytes += file_bytes(info);
+    }
+    return bytes;
+}
+
+size_t TrieSearch::file_bytes(const FileInfo& info) {
+    auto heap = [](const std::string& s) { return s.capacity() > 15 ? s.capacity() + 1 : 0; };
+    return sizeof(FileInfo) + heap(info.filename) + heap(info.absolute_path) + heap(info.extension);
+}
+
+size_t TrieSearch::subtree_bytes(TrieNode* node) {
+    size_t bytes = node_bytes(node);
+    for (auto& pair : node->get_children()) {
+        bytes += subtree_bytes(pair.second);
+    }
+    return bytes;
+}
+
+TrieSearch::SpillUnit& TrieSearch::unit_state(TrieNode* unit) {
+    auto it = units.find(unit);
+    if (it == units.end()) {
+        SpillUnit state;
+        state.bytes = subtree_bytes(unit);
+        resident_bytes += state.bytes;
+        it = units.emplace(unit, state).first;
+    }
+    return it->second;
+}
+
+TrieSearch::SpillUnit& TrieSearch::touch(TrieNode* unit) {
+    SpillUnit& state = unit_state(unit);
+    if (state.spilled) {
+        stats.misses++;
+        fault_in(unit, state);
+    } else {
+        stats.hits++;
+    }
+    state.last_access = access_clock;
+    return state;
+}
+
+TrieNode* TrieSearch::descend(TrieNode* node, char c, size_t depth) {
+    TrieNode* child = node->get_child(fold_case(c));
+    if (child != nullptr && depth + 1 == SPILL_DEPTH) {
+        touch(child);
+    }
+    return child;
+}
+
+void TrieSearch::insert(const std::string& filename, const std::string& absolute_path, const std::string& extension,
+                        int64_t fileid) {
+    access_clock++;
+    FileInfo info(filename, absolute_path, extension, fileid);
     TrieNode* current = root;
+    size_t added = 0;
+    size_t depth = 0;
+
+    for (; depth < filename.size() && depth < SPILL_DEPTH; depth++) {
+        char c = fold_case(filename[depth]);
+        bool created = !current->has_child(c);
+        current = current->add_child(c);
+        if (created && depth + 1 < SPILL_DEPTH) {
+            added += sizeof(TrieNode) + sizeof(void*) * 4;
+        }
+    }
+
+    if (depth < SPILL_DEPTH) {
+        current->set_leaf(true);
+        if (current->add_file_info(info)) {
+            added += file_bytes(info);
+        }
+        resident_bytes += added;
+        return;
+    }
+
+    SpillUnit& unit = unit_state(current);
+    unit.last_access = access_clock;
+
+    // A re-crawl re-adds mostly unchanged files; those leave the unit's
+    // spilled copy valid. Queued inserts are checked when they're merged.
+    size_t unit_added = 0;
+    if (unit.spilled) {
+        auto [slot, queued] = unit.pending.emplace(absolute_path, info);
+        if (queued) {
+            unit_added = file_bytes(info);
+        } else {
+            slot->second = std::move(info);
+        }
+    } else {
+        bool changed = false;
+        unit_added = insert_below(current, info, SPILL_DEPTH, changed);
+        unit.dirty |= changed;
+    }
+    unit.bytes += unit_added;
+    resident_bytes += added + unit_added;
+
+    if (memory_budget > 0 && ++inserts_since_check >= BUDGET_CHECK_INTERVAL) {
+        inserts_since_check = 0;
+        enforce_budget();
+    }
+}
 
-    for (char c : filename) {
-        current = current->add_child(std::tolower(c));
+size_t TrieSearch::insert_below(TrieNode* node, const FileInfo& info, size_t depth, bool& changed) {
+    size_t added = 0;
+    for (; depth < info.filename.size(); depth++) {
+        char c = fold_case(info.filename[depth]);
+        if (!node->has_child(c)) {
+            added += sizeof(TrieNode) + sizeof(void*) * 4;
+        }
+        node = node->add_child(c);
     }
 
-    current->set_leaf(true);
-    current->set_file_info(FileInfo(filename, absolute_path, extension));
+    node->set_leaf(true);
+    if (node->add_file_info(info, &changed)) {
+        added += file_bytes(info);
+    }
+    return added;
 }
 
 bool TrieSearch::search(const std::string& filename) {
+    access_clock++;
     TrieNode* current = root;
 
-    for (char c : filename) {
-        current = current->get_child(std::tolower(c));
-        if (current == nullptr) {
-            return false;
-        }
+    for (size_t depth = 0; depth < filename.size() && current != nullptr; depth++) {
+        current = descend(current, filename[depth], depth);
     }
 
-    return current->check_leaf();
+    bool found = current != nullptr && current->check_leaf();
+    enforce_budget();
+    return found;
 }
 
 std::vector<FileInfo> TrieSearch::search_prefix(const std::string& prefix) {
+    access_clock++;
     std::vector<FileInfo> results;
     TrieNode* current = root;
 
-    for (char c : prefix) {
-        current = current->get_child(std::tolower(c));
-        if (current == nullptr) {
-            return results;
-        }
+    for (size_t depth = 0; depth < prefix.size() && current != nullptr; depth++) {
+        current = descend(current, prefix[depth], depth);
     }
 
-    collect_all_files(current, prefix, results);
+    if (current != nullptr) {
+        collect_all_files(current, prefix, results);
+    }
 
+    enforce_budget();
     return results;
 }
 
 std::vector<FileInfo> TrieSearch::search_prefix_n_results(const std::string& prefix, int num_results) {
+    return search_prefix_n_results(prefix, num_results, nullptr);
+}
+
+std::vector<FileInfo> TrieSearch::search_prefix_n_results(const std::string& prefix, int num_results,
+                                                          const std::function<bool(const FileInfo&)>& accept) {
+    access_clock++;
     std::vector<FileInfo> results;
     TrieNode* current = root;
 
-    for (char c : prefix) {
-        current = current->get_child(std::tolower(c));
-        if (current == nullptr) {
-            return results;
-        }
+    for (size_t depth = 0; depth < prefix.size() && current != nullptr; depth++) {
+        current = descend(current, prefix[depth], depth);
     }
 
-    collect_n_files(current, prefix, results, num_results);
+    if (current != nullptr) {
+        collect_n_files(current, prefix, results, num_results, accept);
+    }
 
+    enforce_budget();
     return results;
 }
 
-void TrieSearch::collect_n_files(TrieNode *node, const std::string& prefix, std::vector<FileInfo> &results, int n) {
+void TrieSearch::collect_n_files(TrieNode *node, const std::string& prefix, std::vector<FileInfo> &results, int n,
+                                 const std::function<bool(const FileInfo&)>& accept) {
     if (n <= 0) return;
+    size_t limit = static_cast<size_t>(n);
     std::queue<std::pair<TrieNode*, std::string>> q;
     q.emplace(node, prefix);
 
-    while (!q.empty() && results.size() < n) {
+    while (!q.empty() && results.size() < limit) {
         auto [current, path] = q.front();
         q.pop();
 
+        if (path.size() == SPILL_DEPTH) {
+            touch(current);
+        }
+
         if (current->check_leaf()) {
-            results.push_back(current->get_file_info());
-            if (results.size() >= n) {
-                return;
+            for (const auto& info : current->get_files()) {
+                if (accept && !accept(info)) {
+                    continue;
+                }
+                results.push_back(info);
+                if (results.size() >= limit) {
+                    return;
+                }
             }
         }
 
@@ -147,9 +338,122 @@ void TrieSearch::collect_n_files(TrieNode *node, const std::string& prefix, std:
     }
 }
 
+struct TrieSearch::FuzzyWalk {
+    std::string query;
+    int bound = 0;
+    size_t limit = 0;
+    const std::function<bool(const FileInfo&)>* accept = nullptr;
+    std::vector<FuzzyMatch>* results = nullptr;
+
+    bool full() const { return results->size() >= limit; }
+};
+
+// The walk runs a Levenshtein automaton in lockstep with the trie: row[j]
+// is the edit distance between the name so far and the first j query
+// characters, one row per trie edge, so a subtree is dropped as soon as no
+// cell is within the bound. A name's distance is the best row.back() along
+// its path, i.e. that of its closest prefix. Passes run with bound 0, 1, 2
+// ... and each keeps only names at exactly its bound, so results come out
+// nearest first and the cheap tight passes can fill the page alone.
+std::vector<FuzzyMatch> TrieSearch::search_fuzzy_n_results(const std::string& prefix, int max_distance,
+                                                           int num_results,
+                                                           const std::function<bool(const FileInfo&)>& accept) {
+    access_clock++;
+    std::vector<FuzzyMatch> results;
+    if (num_results <= 0 || max_distance < 0) {
+        return results;
+    }
+
+    FuzzyWalk walk;
+    for (char c : prefix) {
+        walk.query.push_back(fold_case(c));
+    }
+    walk.limit = num_results;
+    walk.accept = accept ? &accept : nullptr;
+    walk.results = &results;
+
+    std::vector<int> row(walk.query.size() + 1);
+    for (size_t j = 0; j < row.size(); j++) {
+        row[j] = static_cast<int>(j);
+    }
+    for (walk.bound = 0; walk.bound <= max_distance && !walk.full(); walk.bound++) {
+        fuzzy_walk(root, 0, row, row.back(), walk);
+    }
+
+    enforce_budget();
+    return results;
+}
+
+void TrieSearch::fuzzy_walk(TrieNode* node, size_t depth, const std::vector<int>& row, int best, FuzzyWalk& walk) {
+    if (depth == SPILL_DEPTH) {
+        touch(node);
+    }
+
+    // Nothing below can get closer than this; the whole subtree is at
+    // distance best, or out of range.
+    if (*std::min_element(row.begin(), row.end()) > walk.bound) {
+        if (best == walk.bound) {
+            fuzzy_collect(node, depth, best, walk);
+        }
+        return;
+    }
+
+    if (node->check_leaf() && best == walk.bound) {
+        for (const auto& info : node->get_files()) {
+            if (walk.accept && !(*walk.accept)(info)) {
+                continue;
+            }
+            walk.results->push_back({info, best});
+            if (walk.full()) {
+                return;
+            }
+        }
+    }
+
+    std::vector<int> next(row.size());
+    for (auto& [c, child] : node->get_children()) {
+        next[0] = row[0] + 1;
+        for (size_t j = 1; j < row.size(); j++) {
+            int substitute = row[j - 1] + (walk.query[j - 1] != c);
+            next[j] = std::min({next[j - 1] + 1, row[j] + 1, substitute});
+        }
+        fuzzy_walk(child, depth + 1, next, std::min(best, next.back()), walk);
+        if (walk.full()) {
+            return;
+        }
+    }
+}
+
+void TrieSearch::fuzzy_collect(TrieNode* node, size_t depth, int distance, FuzzyWalk& walk) {
+    if (depth == SPILL_DEPTH) {
+        touch(node);
+    }
+    if (node->check_leaf()) {
+        for (const auto& info : node->get_files()) {
+            if (walk.accept && !(*walk.accept)(info)) {
+                continue;
+            }
+            walk.results->push_back({info, distance});
+            if (walk.full()) {
+                return;
+            }
+        }
+    }
+    for (auto& [c, child] : node->get_children()) {
+        fuzzy_collect(child, depth + 1, distance, walk);
+        if (walk.full()) {
+            return;
+        }
+    }
+}
+
 void TrieSearch::collect_all_files(TrieNode* node, std::string prefix, std::vector<FileInfo>& results) {
+    if (prefix.size() == SPILL_DEPTH) {
+        touch(node);
+    }
+
     if (node->check_leaf()) {
-        results.push_back(node->get_file_info());
+        results.insert(results.end(), node->get_files().begin(), node->get_files().end());
     }
 
     for (auto& pair : node->get_children()) {
@@ -158,10 +462,41 @@ void TrieSearch::collect_all_files(TrieNode* node, std::string prefix, std::vect
 }
 
 bool TrieSearch::remove(const std::string& filename) {
-    return remove_helper(root, filename, 0);
+    return remove_files(filename, nullptr);
 }
 
-bool TrieSearch::remove_helper(TrieNode* node, const std::string& filename, int depth) {
+// Only the entry for absolute_path goes; the leaf and any nodes left empty
+// are pruned once no file shares the name.
+bool TrieSearch::remove_file(const std::string& filename, const std::string& absolute_path) {
+    return remove_files(filename, &absolute_path);
+}
+
+bool TrieSearch::remove_files(const std::string& filename, const std::string* absolute_path) {
+    access_clock++;
+    freed_bytes = 0;
+    removed_any = false;
+    remove_helper(root, filename, 0, absolute_path);
+    bool removed = removed_any;
+
+    // Everything freed below the unit was counted in it; a deleted unit
+    // already dropped its own entry.
+    if (filename.size() >= SPILL_DEPTH) {
+        TrieNode* first = root->get_child(fold_case(filename[0]));
+        TrieNode* unit = first ? first->get_child(fold_case(filename[1])) : nullptr;
+        auto it = unit ? units.find(unit) : units.end();
+        if (it != units.end() && removed) {
+            it->second.bytes -= std::min(it->second.bytes, freed_bytes);
+            it->second.dirty = true;
+        }
+    }
+    resident_bytes -= std::min(resident_bytes, freed_bytes);
+
+    enforce_budget();
+    return removed;
+}
+
+bool TrieSearch::remove_helper(TrieNode* node, const std::string& filename, size_t depth,
+                               const std::string* absolute_path) {
     if (node == nullptr) {
         return false;
     }
@@ -171,49 +506,322 @@ bool TrieSearch::remove_helper(TrieNode* node, const std::string& filename, int
             return false;
         }
 
+        std::vector<FileInfo>& files = node->edit_files();
+        for (auto it = files.begin(); it != files.end();) {
+            if (absolute_path && it->absolute_path != *absolute_path) {
+                ++it;
+                continue;
+            }
+            freed_bytes += file_bytes(*it);
+            removed_any = true;
+            it = files.erase(it);
+        }
+        if (!files.empty()) {
+            return false;
+        }
         node->set_leaf(false);
         return node->get_children().empty();
     }
 
-    char c = std::tolower(filename[depth]);
-    TrieNode* child = node->get_child(c);
+    char c = fold_case(filename[depth]);
+    TrieNode* child = descend(node, c, depth);
 
-    if (remove_helper(child, filename, depth + 1)) {
+    if (remove_helper(child, filename, depth + 1, absolute_path)) {
         node->get_children().erase(c);
+        if (depth + 1 == SPILL_DEPTH) {
+            auto it = units.find(child);
+            if (it != units.end()) {
+                resident_bytes -= std::min(resident_bytes, it->second.bytes);
+                drop_copy(it->second);
+                units.erase(it);
+            }
+        } else {
+            freed_bytes += sizeof(TrieNode) + sizeof(void*) * 4;
+        }
         delete child;
         return !node->check_leaf() && node->get_children().empty();
     }
     return false;
 }
 
+void TrieSearch::set_memory_budget(size_t bytes, const std::string& spill_file) {
+    memory_budget = bytes;
+    spill_path = spill_file;
+    stats.budget_bytes = bytes;
+
+    if (spill.is_open()) {
+        spill.close();
+    }
+    if (memory_budget > 0) {
+        reset_spill();
+        if (!spill) {
+            std::cerr << "Error opening trie spill file: " << spill_path << ", budget disabled" << std::endl;
+            memory_budget = 0;
+        }
+    }
+    account_all();
+    enforce_budget();
+}
+
+TrieCacheStats TrieSearch::cache_stats() const {
+    TrieCacheStats out = stats;
+    out.resident_bytes = resident_bytes;
+    out.spilled_subtrees = 0;
+    for (const auto& [node, state] : units) {
+        out.spilled_subtrees += state.spilled;
+    }
+    return out;
+}
+
+// Recomputes the estimate from scratch after the tree was replaced.
+void TrieSearch::account_all() {
+    units.clear();
+    resident_bytes = 0;
+
+    std::vector<std::pair<TrieNode*, size_t>> stack = {{root, 0}};
+    while (!stack.empty()) {
+        auto [node, depth] = stack.back();
+        stack.pop_back();
+        if (depth == SPILL_DEPTH) {
+            SpillUnit state;
+            state.bytes = subtree_bytes(node);
+            state.last_access = access_clock;
+            resident_bytes += state.bytes;
+            units.emplace(node, state);
+            continue;
+        }
+        resident_bytes += node_bytes(node);
+        for (auto& pair : node->get_children()) {
+            stack.emplace_back(pair.second, depth + 1);
+        }
+    }
+}
+
+void TrieSearch::enforce_budget() {
+    if (memory_budget == 0 || resident_bytes <= memory_budget) {
+        return;
+    }
+
+    // Spilled stubs with queued inserts are candidates too: evicting them
+    // merges the queue into the spill file.
+    std::vector<std::pair<uint64_t, TrieNode*>> candidates;
+    for (auto& [node, state] : units) {
+        if ((!state.spilled && state.bytes > sizeof(TrieNode)) || !state.pending.empty()) {
+            candidates.emplace_back(state.last_access, node);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    // Evict down to 90% so the next few inserts don't trigger another pass.
+    size_t target = memory_budget - memory_budget / 10;
+    for (auto& [access, node] : candidates) {
+        if (resident_bytes <= target) {
+            break;
+        }
+        SpillUnit& state = units[node];
+        if (state.spilled) {
+            fault_in(node, state);
+        }
+        evict(node, state);
+    }
+
+    if (spill_bytes >= SPILL_COMPACT_MIN && spill_dead * 2 >= spill_bytes) {
+        compact_spill();
+    }
+}
+
+void TrieSearch::evict(TrieNode* unit, SpillUnit& state) {
+    // A unit that hasn't changed since it was last read back still has a
+    // valid copy in the spill file.
+    if (state.dirty || state.offset < 0) {
+        drop_copy(state);
+        spill.clear();
+        spill.seekp(spill_bytes);
+        save_node(unit, spill, SPILL_DEPTH);
+        spill.flush();
+        if (!spill) {
+            std::cerr << "Error writing trie spill file: " << spill_path << std::endl;
+            spill.clear();
+            return;
+        }
+        state.offset = spill_bytes;
+        spill_bytes = spill.tellp();
+        state.length = spill_bytes - state.offset;
+    }
+
+    for (auto& pair : unit->get_children()) {
+        delete pair.second;
+    }
+    unit->get_children().clear();
+    unit->edit_files().clear();
+    unit->edit_files().shrink_to_fit();
+
+    size_t stub = node_bytes(unit);
+    resident_bytes -= std::min(resident_bytes, state.bytes - std::min(state.bytes, stub));
+    state.bytes = stub;
+    state.spilled = true;
+    state.dirty = false;
+    stats.evictions++;
+}
+
+TrieNode* TrieSearch::read_spilled(const SpillUnit& state) {
+    spill.clear();
+    spill.seekg(state.offset);
+    return load_node(spill);
+}
+
+// The unit's copy in the spill file is stale or gone; its bytes are
+// reclaimed at the next compaction.
+void TrieSearch::drop_copy(SpillUnit& state) {
+    if (state.offset >= 0) {
+        spill_dead += state.length;
+        state.offset = -1;
+        state.length = 0;
+    }
+}
+
+void TrieSearch::reset_spill() {
+    spill.open(spill_path, std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+    spill_bytes = 0;
+    spill_dead = 0;
+}
+
+// Copies the live subtrees into a new spill file and swaps it in. The new
+// file is opened for reading and writing before it replaces the old one,
+// so there is no reopen to fail afterwards; until the rename the old file
+// stays in use, and spilled units are never lost to a failed compaction.
+void TrieSearch::compact_spill() {
+    std::vector<SpillUnit*> live;
+    for (auto& [node, state] : units) {
+        if (state.offset >= 0) {
+            live.push_back(&state);
+        }
+    }
+    std::sort(live.begin(), live.end(), [](const SpillUnit* a, const SpillUnit* b) { return a->offset < b->offset; });
+
+    std::string compact_path = spill_path + ".compact";
+    std::fstream out(compact_path, std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+    std::vector<std::streamoff> offsets;
+    offsets.reserve(live.size());
+    std::vector<char> buffer;
+    std::streamoff end = 0;
+    for (const SpillUnit* state : live) {
+        buffer.resize(static_cast<size_t>(state->length));
+        spill.clear();
+        spill.seekg(state->offset);
+        spill.read(buffer.data(), state->length);
+        out.write(buffer.data(), state->length);
+        offsets.push_back(end);
+        end += state->length;
+    }
+    out.flush();
+    if (!spill || !out || std::rename(compact_path.c_str(), spill_path.c_str()) != 0) {
+        std::cerr << "Error compacting trie spill file: " << spill_path << std::endl;
+        spill.clear();
+        out.close();
+        std::remove(compact_path.c_str());
+        return;
+    }
+
+    spill.close();
+    spill = std::move(out);
+    for (size_t i = 0; i < live.size(); i++) {
+        live[i]->offset = offsets[i];
+    }
+    spill_bytes = end;
+    spill_dead = 0;
+}
+
+void TrieSearch::fault_in(TrieNode* unit, SpillUnit& state) {
+    TrieNode* loaded = read_spilled(state);
+    std::swap(unit->get_children(), loaded->get_children());
+    std::swap(unit->edit_files(), loaded->edit_files());
+    unit->set_leaf(loaded->check_leaf());
+    delete loaded;
+
+    bool changed = false;
+    for (const auto& [path, info] : state.pending) {
+        insert_below(unit, info, SPILL_DEPTH, changed);
+    }
+    state.dirty |= changed;
+    state.pending = {};
+
+    size_t before = state.bytes;
+    state.bytes = subtree_bytes(unit);
+    resident_bytes += state.bytes;
+    resident_bytes -= std::min(resident_bytes, before);
+    state.spilled = false;
+}
+
 void TrieSearch::save(const std::string& filename) {
     std::ofstream out(filename, std::ios::binary);
     if (!out) {
         std::cerr << "Error opening file for writing: " << filename << std::endl;
         return;
     }
+    out.write(TRIE_MAGIC, sizeof(TRIE_MAGIC));
+    out.write(reinterpret_cast<const char*>(&TRIE_VERSION), sizeof(TRIE_VERSION));
     save_node(root, out);
 }
 
-void TrieSearch::load(const std::string& filename) {
+bool TrieSearch::load(const std::string& filename) {
     std::ifstream in(filename, std::ios::binary);
     if (!in) {
         std::cerr << "Error opening file for reading: " << filename << std::endl;
-        return;
+        return false;
     }
+
+    char magic[sizeof(TRIE_MAGIC)];
+    uint32_t version = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    if (!in || std::memcmp(magic, TRIE_MAGIC, sizeof(magic)) != 0 || version != TRIE_VERSION) {
+        std::cerr << "Unsupported trie format in " << filename << ", waiting for the indexer to rewrite it" << std::endl;
+        return false;
+    }
+
     delete root;
     root = load_node(in);
+
+    if (spill.is_open()) {
+        spill.close();
+        reset_spill();
+    }
+    account_all();
+    enforce_budget();
+    return static_cast<bool>(in);
 }
 
-void TrieSearch::save_node(TrieNode* node, std::ofstream& out) {
+void TrieSearch::save_node(TrieNode* node, std::ostream& out, size_t depth) {
+    // Spilled subtrees are copied from the spill file without being made
+    // resident again.
+    if (depth == SPILL_DEPTH && node != root) {
+        auto it = units.find(node);
+        if (it != units.end() && it->second.spilled && &out != &spill) {
+            TrieNode* loaded = read_spilled(it->second);
+            bool changed = false;
+            for (const auto& [path, info] : it->second.pending) {
+                insert_below(loaded, info, SPILL_DEPTH, changed);
+            }
+            save_node(loaded, out, depth + 1);
+            delete loaded;
+            return;
+        }
+    }
+
     bool is_leaf = node->check_leaf();
     out.write(reinterpret_cast<const char*>(&is_leaf), sizeof(is_leaf));
 
     if (is_leaf) {
-        FileInfo info = node->get_file_info();
-        write_string(out, info.filename);
-        write_string(out, info.absolute_path);
-        write_string(out, info.extension);
+        size_t num_files = node->get_files().size();
+        out.write(reinterpret_cast<const char*>(&num_files), sizeof(num_files));
+        for (const auto& info : node->get_files()) {
+            write_string(out, info.filename);
+            write_string(out, info.absolute_path);
+            write_string(out, info.extension);
+            out.write(reinterpret_cast<const char*>(&info.fileid), sizeof(info.fileid));
+        }
     }
 
     size_t num_children = node->get_children().size();
@@ -221,21 +829,28 @@ void TrieSearch::save_node(TrieNode* node, std::ofstream& out) {
 
     for (auto const& [key, val] : node->get_children()) {
         out.write(reinterpret_cast<const char*>(&key), sizeof(key));
-        save_node(val, out);
+        save_node(val, out, depth + 1);
     }
 }
 
-TrieNode* TrieSearch::load_node(std::ifstream& in) {
+TrieNode* TrieSearch::load_node(std::istream& in) {
     TrieNode* node = new TrieNode();
     bool is_leaf;
     in.read(reinterpret_cast<char*>(&is_leaf), sizeof(is_leaf));
     node->set_leaf(is_leaf);
 
     if (is_leaf) {
-        std::string filename = read_string(in);
-        std::string absolute_path = read_string(in);
-        std::string extension = read_string(in);
-        node->set_file_info(FileInfo(filename, absolute_path, extension));
+        size_t num_files;
+        in.read(reinterpret_cast<char*>(&num_files), sizeof(num_files));
+        node->edit_files().reserve(num_files);
+        for (size_t i = 0; i < num_files; ++i) {
+            std::string filename = read_string(in);
+            std::string absolute_path = read_string(in);
+            std::string extension = read_string(in);
+            int64_t fileid;
+            in.read(reinterpret_cast<char*>(&fileid), sizeof(fileid));
+            node->edit_files().emplace_back(filename, absolute_path, extension, fileid);
+        }
     }
 
     size_t num_children;
@@ -249,4 +864,4 @@ TrieNode* TrieSearch::load_node(std::ifstream& in) {
     }
 
     return node;
-}
\ No newline at end of file
+}
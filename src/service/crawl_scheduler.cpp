@@ -0,0 +1,216 @@
+#include "crawl_scheduler.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+using namespace std::chrono;
+
+namespace {
+
+constexpr milliseconds INITIAL_BACKOFF{250};
+constexpr milliseconds MAX_BACKOFF{8000};
+
+// A crawl keeps going after this much backoff in one batch, so a machine
+// that is permanently busy still gets its index updated eventually.
+constexpr milliseconds MAX_BACKOFF_PER_BATCH{60000};
+
+constexpr int CRAWL_NICE = 10;
+
+// Reads "some avg10=" from a /proc/pressure file: the share of the last ten
+// seconds in which at least one task stalled on that resource.
+bool read_pressure(const char* path, double& avg10) {
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, 5, "some ") != 0) {
+            continue;
+        }
+        size_t pos = line.find("avg10=");
+        if (pos == std::string::npos) {
+            return false;
+        }
+        avg10 = std::strtod(line.c_str() + pos + 6, nullptr);
+        return true;
+    }
+    return false;
+}
+
+bool read_load_per_cpu(double& load) {
+    double avg[1];
+    if (getloadavg(avg, 1) != 1) {
+        return false;
+    }
+    unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    load = avg[0] / cpus;
+    return true;
+}
+
+}
+
+CrawlScheduler::CrawlScheduler(FileSystemCrawler& crawler, const SpotlightConfig& config)
+    : crawler(crawler), config(config) {
+    this->config.scan_min_interval_s = std::max<size_t>(1, config.scan_min_interval_s);
+    this->config.scan_max_interval_s = std::max(this->config.scan_min_interval_s, config.scan_max_interval_s);
+    this->config.scan_initial_interval_s = std::clamp(config.scan_initial_interval_s,
+                                                      this->config.scan_min_interval_s,
+                                                      this->config.scan_max_interval_s);
+
+    crawler.set_batch_hook([this]() { throttle(); });
+}
+
+void CrawlScheduler::throttle() {
+    milliseconds delay = INITIAL_BACKOFF;
+    milliseconds waited{0};
+    while (waited < MAX_BACKOFF_PER_BATCH && under_pressure()) {
+        std::this_thread::sleep_for(delay);
+        waited += delay;
+        delay = std::min(delay * 2, MAX_BACKOFF);
+    }
+    throttled += waited;
+}
+
+bool CrawlScheduler::under_pressure() const {
+    double io = 0, cpu = 0;
+    bool has_io = read_pressure("/proc/pressure/io", io);
+    bool has_cpu = read_pressure("/proc/pressure/cpu", cpu);
+
+    if (has_io && config.io_pressure_limit > 0 && io > config.io_pressure_limit) {
+        return true;
+    }
+    if (has_cpu && config.cpu_pressure_limit > 0 && cpu > config.cpu_pressure_limit) {
+        return true;
+    }
+    if (!has_io && !has_cpu && config.load_limit > 0) {
+        double load = 0;
+        return read_load_per_cpu(load) && load > config.load_limit;
+    }
+    return false;
+}
+
+void CrawlScheduler::discover() {
+    std::vector<Unit> found;
+    std::error_code ec;
+    for (fs::directory_iterator it(crawler.get_root(), fs::directory_options::skip_permission_denied, ec), end;
+         !ec && it != end; it.increment(ec)) {
+        std::error_code type_ec;
+        if (!it->is_directory(type_ec) || crawler.is_ignorable(it->path().filename().string())) {
+            continue;
+        }
+
+        std::string path = it->path().string();
+        auto existing = std::find_if(units.begin(), units.end(),
+                                     [&](const Unit& u) { return u.path == path; });
+        if (existing != units.end()) {
+            found.push_back(std::move(*existing));
+        } else {
+            Unit unit;
+            unit.path = path;
+            unit.interval = seconds(config.scan_initial_interval_s);
+            found.push_back(std::move(unit));
+        }
+    }
+    if (ec) {
+        std::cerr << "Error listing " << crawler.get_root() << ": " << ec.message() << '\n';
+    }
+    units = std::move(found);
+}
+
+void CrawlScheduler::full_crawl() {
+    crawler.initializing_crawl();
+    discover();
+    restart_clocks();
+}
+
+bool CrawlScheduler::resume(bool from_database) {
+    bool resumed = crawler.resume_crawl(from_database);
+    discover();
+    restart_clocks();
+    return resumed;
+}
+
+// Everything is up to date, so each unit's clock restarts; a full crawl's
+// fingerprint covers the whole root and says nothing per unit.
+void CrawlScheduler::restart_clocks() {
+    clock::time_point now = clock::now();
+    for (auto& unit : units) {
+        unit.next_due = now + unit.interval;
+    }
+    next_full_crawl = now + seconds(config.scan_max_interval_s);
+}
+
+void CrawlScheduler::crawl_unit(Unit& unit) {
+    crawler.crawl(unit.path);
+    uint64_t fingerprint = crawler.last_crawl_stats().fingerprint;
+
+    seconds min_interval(config.scan_min_interval_s);
+    seconds max_interval(config.scan_max_interval_s);
+    if (unit.scanned) {
+        if (fingerprint != unit.fingerprint) {
+            unit.interval = std::max(min_interval, unit.interval / 2);
+        } else {
+            unit.interval = std::min(max_interval, unit.interval * 2);
+        }
+    }
+    unit.fingerprint = fingerprint;
+    unit.scanned = true;
+    unit.next_due = clock::now() + unit.interval;
+}
+
+bool CrawlScheduler::tick() {
+    if (clock::now() >= next_full_crawl) {
+        full_crawl();
+        return true;
+    }
+
+    bool crawled = false;
+    for (auto& unit : units) {
+        if (clock::now() >= unit.next_due) {
+            crawl_unit(unit);
+            crawled = true;
+        }
+    }
+    return crawled;
+}
+
+CrawlScheduler::clock::time_point CrawlScheduler::next_due() const {
+    clock::time_point due = next_full_crawl;
+    for (const auto& unit : units) {
+        due = std::min(due, unit.next_due);
+    }
+    return due;
+}
+
+std::chrono::milliseconds CrawlScheduler::take_throttled_time() {
+    milliseconds t = throttled;
+    throttled = milliseconds(0);
+    return t;
+}
+
+void CrawlScheduler::lower_thread_priority() {
+#ifdef __linux__
+    // ioprio_set has no glibc wrapper; these mirror <linux/ioprio.h>.
+    constexpr int IOPRIO_WHO_PROCESS = 1;
+    constexpr int IOPRIO_CLASS_IDLE = 3;
+    constexpr int IOPRIO_CLASS_SHIFT = 13;
+
+    // With who == 0 both calls apply to the calling thread only.
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) != 0) {
+        std::cerr << "Could not set idle I/O priority\n";
+    }
+    pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+    if (setpriority(PRIO_PROCESS, tid, CRAWL_NICE) != 0) {
+        std::cerr << "Could not lower crawl thread priority\n";
+    }
+#endif
+}
@@ -2,13 +2,22 @@
 #include <condition_variable>
 #include <thread>
 #include "file_crawler.h"
+#include "config.h"
+#include "crawl_scheduler.h"
+#include "shard.h"
+#include "content_indexer.h"
+#include "prefix_table.h"
+#include <filesystem>
+#include <memory>
 
 // this will be a systemd service
 
 std::mutex m;
 std::condition_variable cv;
+std::mutex log_mutex;
 
 void log(const std::string& s) {
+    std::lock_guard<std::mutex> lock(log_mutex);
     std::cout << s << std::endl;
 }
 
@@ -33,21 +42,206 @@ std::string current_datetime() {
     return oss.str();
 }
 
-void re_index(FileSystemCrawler* fs) {
+// Each file is written beside its final path and renamed over it, so a
+// client reloading mid-save reads either the old snapshot or the new one.
+template <typename Save>
+void publish(const ShardLayout& shard, const std::string& what, const std::string& path, Save save) {
+    std::string staged = path + ".tmp";
+    save(staged);
+    std::error_code ec;
+    std::filesystem::rename(staged, path, ec);
+    if (ec) {
+        log("[" + shard.name + "] could not save " + what + " to " + path + ": " + ec.message());
+        return;
+    }
+    log("[" + shard.name + "] saved " + what + " to " + path);
+}
+
+void save_indexes(FileSystemCrawler* fs, const ShardLayout& shard) {
+    publish(shard, "trie", shard.trie_path, [&](const std::string& path) { fs->get_trie().save(path); });
+    publish(shard, "extension index", shard.ext_index_path,
+            [&](const std::string& path) { fs->get_extension_index().save(path); });
+    publish(shard, "token index", shard.token_index_path,
+            [&](const std::string& path) { fs->get_token_index().save(path); });
+    publish(shard, "directory index", shard.dir_index_path,
+            [&](const std::string& path) { fs->get_directory_index().save(path); });
+    // Built from the token index just compacted by its save.
+    PrefixTable prefixes;
+    prefixes.build(fs->get_db(), fs->get_token_index());
+    publish(shard, "prefix table", shard.prefix_table_path,
+            [&](const std::string& path) { prefixes.save(path); });
+
+    // Written last, so clients only reload once the whole set is in place.
+    SnapshotStamp stamp;
+    stamp.generation = static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count());
+    stamp.database_id = fs->get_db().database_id();
+    if (!write_snapshot_stamp(shard, stamp)) {
+        log("[" + shard.name + "] could not write snapshot stamp " + shard.snapshot_path);
+    }
+
+    TrieCacheStats stats = fs->get_trie().cache_stats();
+    if (stats.budget_bytes > 0) {
+        log("[" + shard.name + "] trie cache: " + std::to_string(stats.resident_bytes >> 20) + "/" +
+            std::to_string(stats.budget_bytes >> 20) + " MB resident, " +
+            std::to_string(stats.spilled_subtrees) + " subtrees spilled, " +
+            std::to_string(stats.hits) + " hits, " + std::to_string(stats.misses) + " misses, " +
+            std::to_string(stats.evictions) + " evictions");
+    }
+}
+
+void index_contents(FileSystemCrawler* fs, CrawlScheduler& scheduler, const ShardLayout& shard,
+                    const SpotlightConfig& config) {
+    ContentIndexer content(fs->get_db(), config);
+    content.set_chunk_hook([&scheduler]() { scheduler.throttle(); });
+    ContentStats stats = content.run();
+    if (stats.reset) {
+        log("[" + shard.name + "] content index had more stale than live documents, rebuilt it");
+    }
+    if (stats.files_read > 0) {
+        log("[" + shard.name + "] indexed contents of " + std::to_string(stats.text_files) + " text files (" +
+            std::to_string(stats.bytes_read >> 20) + " MB read), skipped " +
+            std::to_string(stats.binary_files) + " binary or unreadable");
+    }
+}
+
+// How often an idle shard looks for a rebuild request.
+constexpr auto REBUILD_POLL = std::chrono::seconds(10);
+// How often committed WAL frames are copied back into each shard's database.
+constexpr auto CHECKPOINT_INTERVAL = std::chrono::seconds(30);
+
+// Checkpoints run here rather than on whichever connection happens to
+// commit, so neither crawls nor client searches ever pay for one. Passive
+// checkpoints skip frames a reader still needs; the next pass gets them.
+void checkpoint_shards(std::vector<ShardLayout> shards) {
     while (true) {
-        log("beginning index at " + current_datetime());
-        fs->initializing_crawl();
-        log("created index at " + current_datetime());
-        fs->get_trie().save("/home/a7x/trie.dat");
-        log("saved trie to /home/a7x/trie.dat");
-        std::this_thread::sleep_for(std::chrono::minutes(5));
+        std::this_thread::sleep_for(CHECKPOINT_INTERVAL);
+        for (const auto& shard : shards) {
+            SQLiteWrapper::checkpoint(shard.db_path);
+        }
     }
 }
 
-int main() {
-    FileSystemCrawler crawler("/home");
-    std::thread t(re_index, &crawler);
-    t.detach();
+// Each shard runs on its own thread with its own crawler, so a slow or
+// hung mount only ever delays its own index.
+void re_index(ShardLayout shard, SpotlightConfig config, size_t trie_budget) {
+    if (config.idle_io_priority) {
+        CrawlScheduler::lower_thread_priority();
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(shard.directory, ec);
+
+    while (true) {
+        if (take_rebuild_request(shard)) {
+            log("[" + shard.name + "] rebuilding from scratch");
+            remove_shard_files(shard);
+        }
+
+        auto make_crawler = [&] {
+            auto crawler = std::make_unique<FileSystemCrawler>(shard.root, shard.db_path);
+            if (trie_budget > 0) {
+                crawler->get_trie().set_memory_budget(trie_budget, shard.spill_path);
+            }
+            crawler->set_checkpoint_path(shard.checkpoint_path);
+            crawler->set_ignore_rules(shard_ignore_rules(config, shard), config.ignore_files);
+            crawler->set_one_filesystem(config.one_filesystem);
+            return crawler;
+        };
+        auto crawler = make_crawler();
+
+        // After a restart the saved index is still good: load it and only
+        // finish whatever crawl was cut short, instead of starting over.
+        bool have_index = std::filesystem::exists(shard.trie_path) &&
+                          crawler->get_trie().load(shard.trie_path) &&
+                          crawler->get_extension_index().load(shard.ext_index_path) &&
+                          crawler->get_token_index().load(shard.token_index_path) &&
+                          crawler->get_directory_index().load(shard.dir_index_path);
+        if (!have_index) {
+            // Whatever part did load is dropped rather than mixed in.
+            crawler.reset();
+            crawler = make_crawler();
+        }
+        CrawlScheduler scheduler(*crawler, config);
+
+        // A crawl cut short before any index was saved, the first one most
+        // likely, left its files in the database: the index is rebuilt from
+        // there and the crawl finished from its checkpoint.
+        if (have_index) {
+            log("[" + shard.name + "] loaded saved index, resuming at " + current_datetime());
+            if (scheduler.resume()) {
+                log("[" + shard.name + "] finished interrupted crawl at " + current_datetime());
+            }
+        } else if (std::filesystem::exists(shard.checkpoint_path) && scheduler.resume(true)) {
+            log("[" + shard.name + "] rebuilt index from the database and finished interrupted crawl at " +
+                current_datetime());
+        } else {
+            log("[" + shard.name + "] beginning index of " + shard.root + " at " + current_datetime());
+            scheduler.full_crawl();
+            log("[" + shard.name + "] created index at " + current_datetime());
+            const CrawlStats& stats = crawler->last_crawl_stats();
+            if (stats.aliases > 0 || stats.other_filesystems > 0) {
+                log("[" + shard.name + "] skipped " + std::to_string(stats.aliases) +
+                    " aliased directories and " + std::to_string(stats.other_filesystems) + " mount points");
+            }
+        }
+        save_indexes(crawler.get(), shard);
+        if (config.content_indexing) {
+            index_contents(crawler.get(), scheduler, shard, config);
+        }
+        // A full crawl leaves a WAL as large as the database; fold it in and
+        // shrink the file now that the writes are done.
+        SQLiteWrapper::checkpoint(shard.db_path, true);
+
+        while (!take_rebuild_request(shard)) {
+            std::this_thread::sleep_until(std::min(scheduler.next_due(), CrawlScheduler::clock::now() + REBUILD_POLL));
+            if (!scheduler.tick()) {
+                continue;
+            }
+            log("[" + shard.name + "] updated index at " + current_datetime());
+            auto throttled = scheduler.take_throttled_time();
+            if (throttled.count() > 0) {
+                log("[" + shard.name + "] backed off for " + std::to_string(throttled.count()) +
+                    " ms under system pressure");
+            }
+            save_indexes(crawler.get(), shard);
+            if (config.content_indexing) {
+                index_contents(crawler.get(), scheduler, shard, config);
+            }
+        }
+
+        // Put the request back so the next pass clears the files once this
+        // crawler has closed them.
+        request_rebuild(shard);
+    }
+}
+
+int main(int argc, char** argv) {
+    SpotlightConfig config = load_config();
+    std::vector<ShardLayout> shards = shard_layouts(config);
+
+    // "indexer --rebuild <root>" asks the running service to rebuild one
+    // shard; the others keep their indexes.
+    if (argc == 3 && std::string(argv[1]) == "--rebuild") {
+        ShardLayout target = shard_layout(config, argv[2]);
+        for (const auto& shard : shards) {
+            if (shard.name == target.name) {
+                if (!request_rebuild(shard)) {
+                    std::cerr << "Could not request rebuild of " << shard.root << std::endl;
+                    return 1;
+                }
+                log("requested rebuild of " + shard.root);
+                return 0;
+            }
+        }
+        std::cerr << argv[2] << " is not a configured root" << std::endl;
+        return 1;
+    }
+
+    size_t trie_budget = shards.empty() ? 0 : (config.trie_memory_budget_mb << 20) / shards.size();
+    for (const auto& shard : shards) {
+        std::thread t(re_index, shard, config, trie_budget);
+        t.detach();
+    }
+    std::thread(checkpoint_shards, shards).detach();
     std::unique_lock<std::mutex> lock(m);
     cv.wait(lock);    // waits forever
 